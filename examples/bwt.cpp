@@ -24,196 +24,146 @@
  * OTHER DEALINGS IN THE SOFTWARE.
  */
 
-#if HAVE_CONFIG_H
-# include "config.hpp"
-#endif
-#include <stdio.h>
-#if HAVE_STRING_H
-# include <string.h>
-#endif
-#if HAVE_STDLIB_H
-# include <stdlib.h>
-#endif
-#if HAVE_MEMORY_H
-# include <memory.h>
-#endif
-#if HAVE_STDDEF_H
-# include <stddef.h>
-#endif
-#if HAVE_STRINGS_H
-# include <strings.h>
-#endif
-#if HAVE_SYS_TYPES_H
-# include <sys/types.h>
-#endif
-#if HAVE_IO_H && HAVE_FCNTL_H
-# include <io.h>
-# include <fcntl.h>
-#endif
-#include <time.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include <divsufsort.hpp>
+#include <parallel.hpp>
 
+/* Output format: the block size as a 32-bit little-endian integer, then for
+   each block its primary index and its transformed bytes. When the high bit
+   of the block size is set, it is followed by the sampling interval, and the
+   primary index of each block (m bytes) by their count k = (m - 1) / interval
+   and the k primary indexes of the positions interval, 2 * interval, ... of
+   the block, so that unbwt can decode the block on several threads. */
 
-static
-size_t
-write_int(FILE *fp, saidx_t n) {
+static bool write_int(FILE *fp, int32_t n) {
   unsigned char c[4];
-  c[0] = (unsigned char)((n >>  0) & 0xff), c[1] = (unsigned char)((n >>  8) & 0xff),
-  c[2] = (unsigned char)((n >> 16) & 0xff), c[3] = (unsigned char)((n >> 24) & 0xff);
-  return fwrite(c, sizeof(unsigned char), 4, fp);
+  c[0] = static_cast<unsigned char>((n >>  0) & 0xff), c[1] = static_cast<unsigned char>((n >>  8) & 0xff),
+  c[2] = static_cast<unsigned char>((n >> 16) & 0xff), c[3] = static_cast<unsigned char>((n >> 24) & 0xff);
+  return fwrite(c, sizeof(unsigned char), 4, fp) == 4;
 }
 
-static
-void
-print_help(const char *progname, int status) {
-  fprintf(stderr,
-          "bwt, a burrows-wheeler transform program, version %s.\n",
-          divsufsort_version());
-  fprintf(stderr, "usage: %s [-b num] INFILE OUTFILE\n", progname);
-  fprintf(stderr, "  -b num    set block size to num MiB [1..512] (default: 32)\n\n");
+static void print_help(const char *progname, int status) {
+  std::cerr << "bwt, a burrows-wheeler transform program, version " << divss::divsufsort_version() << ".\n";
+  std::cerr << "usage: " << progname << " [-b num] [-i num] [-t num] INFILE OUTFILE\n";
+  std::cerr << "  -b num    set block size to num MiB [1..512] (default: 32)\n";
+  std::cerr << "  -i num    store a primary index every num KiB for parallel decoding,\n";
+  std::cerr << "            0 for none (default: 256)\n";
+  std::cerr << "  -t num    use num threads, 0 for all (default: 1); up to num blocks\n";
+  std::cerr << "            are transformed at once, each in its own buffers\n\n";
   exit(status);
 }
 
-int
-main(int argc, const char *argv[]) {
+static void fail(const char *progname, const char *what, const char *fname) {
+  std::cerr << progname << ": " << what << " `" << fname << "': ";
+  perror(NULL);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, const char *argv[]) {
   FILE *fp, *ofp;
   const char *fname, *ofname;
-  sauchar_t *T;
-  saidx_t *SA;
-  LFS_OFF_T n;
-  size_t m;
-  saidx_t pidx;
-  clock_t start,finish;
-  saint_t i, blocksize = 32, needclose = 3;
+  int32_t blocksize = 32, interval = 256;
+  unsigned threads = 1;
+  int64_t n = 0, size = -1;
+  int i;
 
   /* Check arguments. */
   if((argc == 1) ||
      (strcmp(argv[1], "-h") == 0) ||
      (strcmp(argv[1], "--help") == 0)) { print_help(argv[0], EXIT_SUCCESS); }
-  if((argc != 3) && (argc != 5)) { print_help(argv[0], EXIT_FAILURE); }
-  i = 1;
-  if(argc == 5) {
-    if(strcmp(argv[i], "-b") != 0) { print_help(argv[0], EXIT_FAILURE); }
-    blocksize = atoi(argv[i + 1]);
-    if(blocksize < 0) { blocksize = 1; }
-    else if(512 < blocksize) { blocksize = 512; }
-    i += 2;
-  }
-  blocksize <<= 20;
-
-  /* Open a file for reading. */
-  if(strcmp(argv[i], "-") != 0) {
-#if HAVE_FOPEN_S
-    if(fopen_s(&fp, fname = argv[i], "rb") != 0) {
-#else
-    if((fp = LFS_FOPEN(fname = argv[i], "rb")) == NULL) {
-#endif
-      fprintf(stderr, "%s: Cannot open file `%s': ", argv[0], fname);
-      perror(NULL);
-      exit(EXIT_FAILURE);
-    }
-  } else {
-#if HAVE__SETMODE && HAVE__FILENO
-    if(_setmode(_fileno(stdin), _O_BINARY) == -1) {
-      fprintf(stderr, "%s: Cannot set mode: ", argv[0]);
-      perror(NULL);
-      exit(EXIT_FAILURE);
-    }
-#endif
-    fp = stdin;
-    fname = "stdin";
-    needclose ^= 1;
-  }
-  i += 1;
-
-  /* Open a file for writing. */
-  if(strcmp(argv[i], "-") != 0) {
-#if HAVE_FOPEN_S
-    if(fopen_s(&ofp, ofname = argv[i], "wb") != 0) {
-#else
-    if((ofp = LFS_FOPEN(ofname = argv[i], "wb")) == NULL) {
-#endif
-      fprintf(stderr, "%s: Cannot open file `%s': ", argv[0], ofname);
-      perror(NULL);
-      exit(EXIT_FAILURE);
-    }
-  } else {
-#if HAVE__SETMODE && HAVE__FILENO
-    if(_setmode(_fileno(stdout), _O_BINARY) == -1) {
-      fprintf(stderr, "%s: Cannot set mode: ", argv[0]);
-      perror(NULL);
-      exit(EXIT_FAILURE);
-    }
-#endif
-    ofp = stdout;
-    ofname = "stdout";
-    needclose ^= 2;
+  for(i = 1; (i + 3 < argc) && (argv[i][0] == '-') && (argv[i][1] != '\0'); i += 2) {
+    if(strcmp(argv[i], "-b") == 0) { blocksize = std::min(std::max(atoi(argv[i + 1]), 1), 512); }
+    else if(strcmp(argv[i], "-i") == 0) { interval = std::max(atoi(argv[i + 1]), 0); }
+    else if(strcmp(argv[i], "-t") == 0) {
+      if((threads = static_cast<unsigned>(atoi(argv[i + 1]))) == 0) { threads = std::thread::hardware_concurrency(); }
+    } else { print_help(argv[0], EXIT_FAILURE); }
   }
+  if(i + 2 != argc) { print_help(argv[0], EXIT_FAILURE); }
+  blocksize <<= 20, interval = std::min(interval, 512 * 1024) << 10;
 
-  /* Get the file size. */
-  if(LFS_FSEEK(fp, 0, SEEK_END) == 0) {
-    n = LFS_FTELL(fp);
+  /* Open the files; "-" stands for stdin and stdout. */
+  if(strcmp(fname = argv[i], "-") == 0) { fp = stdin, fname = "stdin"; }
+  else if((fp = fopen(fname, "rb")) == NULL) { fail(argv[0], "Cannot open file", fname); }
+  if(strcmp(ofname = argv[i + 1], "-") == 0) { ofp = stdout, ofname = "stdout"; }
+  else if((ofp = fopen(ofname, "wb")) == NULL) { fail(argv[0], "Cannot open file", ofname); }
+
+  /* Shrink the block to the file. */
+  if((fseeko(fp, 0, SEEK_END) == 0) && (0 <= (size = ftello(fp)))) {
     rewind(fp);
-    if(n < 0) {
-      fprintf(stderr, "%s: Cannot ftell `%s': ", argv[0], fname);
-      perror(NULL);
-      exit(EXIT_FAILURE);
-    }
-    if(0x20000000L < n) { n = 0x20000000L; }
-    if((blocksize == 0) || (n < blocksize)) { blocksize = (saidx_t)n; }
-  } else if(blocksize == 0) { blocksize = 32 << 20; }
-
-  /* Allocate 5blocksize bytes of memory. */
-  T = (sauchar_t *)malloc(blocksize * sizeof(sauchar_t));
-  SA = (saidx_t *)malloc(blocksize * sizeof(saidx_t));
-  if((T == NULL) || (SA == NULL)) {
-    fprintf(stderr, "%s: Cannot allocate memory.\n", argv[0]);
-    exit(EXIT_FAILURE);
+    if((0 < size) && (size < blocksize)) { blocksize = static_cast<int32_t>(size); }
   }
-
-  /* Write the blocksize. */
-  if(write_int(ofp, blocksize) != 4) {
-    fprintf(stderr, "%s: Cannot write to `%s': ", argv[0], ofname);
-    perror(NULL);
-    exit(EXIT_FAILURE);
+  if(blocksize <= interval) { interval = 0; }
+
+  /* Blocks are transformed by `workers` threads, each with its own buffers;
+     the threads left over go to the blocks themselves. */
+  unsigned workers = std::max(threads, 1u);
+  if(0 <= size) { workers = static_cast<unsigned>(std::min<int64_t>(workers, std::max<int64_t>((size + blocksize - 1) / blocksize, 1))); }
+  const unsigned inner = std::max(threads / workers, 1u);
+
+  /* Write the header. */
+  if(!write_int(ofp, (interval != 0) ? static_cast<int32_t>(blocksize | INT32_C(0x80000000)) : blocksize) ||
+     ((interval != 0) && !write_int(ofp, interval))) {
+    fail(argv[0], "Cannot write to", ofname);
   }
 
-  fprintf(stderr, "  BWT (blocksize %" PRIdSAINT_T ") ... ", blocksize);
-  start = clock();
-  for(n = 0; 0 < (m = fread(T, sizeof(sauchar_t), blocksize, fp)); n += m) {
-    /* Burrows-Wheeler Transform. */
-    pidx = divbwt(T, T, SA, m);
-    if(pidx < 0) {
-      fprintf(stderr, "%s (bw_transform): %s.\n",
-        argv[0],
-        (pidx == -1) ? "Invalid arguments" : "Cannot allocate memory");
-      exit(EXIT_FAILURE);
-    }
-
-    /* Write the bwted data. */
-    if((write_int(ofp, pidx) != 4) ||
-       (fwrite(T, sizeof(sauchar_t), m, ofp) != m)) {
-      fprintf(stderr, "%s: Cannot write to `%s': ", argv[0], ofname);
-      perror(NULL);
-      exit(EXIT_FAILURE);
+  std::cerr << "  BWT (blocksize " << blocksize << ", " << workers << " worker" << ((workers == 1) ? "" : "s") << ") ... ";
+  auto start = std::chrono::high_resolution_clock::now();
+  std::mutex input, output;
+  std::condition_variable turn;
+  int64_t next_block = 0, next_write = 0;
+  divss::internal::parallel_run(workers, [&](unsigned) {
+    std::vector<unsigned char> T(blocksize);
+    std::vector<int32_t> SA(blocksize + 1), indexes((interval != 0) ? (blocksize - 1) / interval + 1 : 0);
+    for(;;) {
+      /* Read the next block, in turn with the other workers. */
+      int64_t block;
+      size_t m;
+      {
+        std::lock_guard<std::mutex> lock(input);
+        if((m = fread(T.data(), sizeof(unsigned char), blocksize, fp)) == 0) {
+          if(ferror(fp)) { fail(argv[0], "Cannot read from", fname); }
+          return;
+        }
+        block = next_block++, n += static_cast<int64_t>(m);
+      }
+
+      /* Burrows-Wheeler Transform. */
+      int32_t pidx = divss::divbwt(T.data(), T.data(), SA.data(), static_cast<int32_t>(m), inner,
+                                   (interval != 0) ? indexes.data() : nullptr, interval);
+      if(pidx < 0) {
+        std::cerr << argv[0] << " (divbwt): Invalid arguments.\n";
+        exit(EXIT_FAILURE);
+      }
+
+      /* Write the bwted data once the blocks before it are written. */
+      std::unique_lock<std::mutex> lock(output);
+      turn.wait(lock, [&]() { return next_write == block; });
+      bool ok = write_int(ofp, pidx);
+      if(interval != 0) {
+        const size_t count = (m - 1) / interval;
+        ok = ok && write_int(ofp, static_cast<int32_t>(count));
+        for(size_t k = 1; ok && (k <= count); ++k) { ok = write_int(ofp, indexes[k]); }
+      }
+      if(!ok || (fwrite(T.data(), sizeof(unsigned char), m, ofp) != m)) { fail(argv[0], "Cannot write to", ofname); }
+      ++next_write;
+      lock.unlock();
+      turn.notify_all();
     }
-  }
-  if(ferror(fp)) {
-    fprintf(stderr, "%s: Cannot read from `%s': ", argv[0], fname);
-    perror(NULL);
-    exit(EXIT_FAILURE);
-  }
-  finish = clock();
-  fprintf(stderr, "%" PRIdOFF_T " bytes: %.4f sec\n",
-    n, (double)(finish - start) / (double)CLOCKS_PER_SEC);
+  });
+  auto finish = std::chrono::high_resolution_clock::now();
+  std::cerr << n << " bytes: " << std::chrono::duration_cast<std::chrono::milliseconds>(finish - start).count() << " ms\n";
 
   /* Close files */
-  if(needclose & 1) { fclose(fp); }
-  if(needclose & 2) { fclose(ofp); }
-
-  /* Deallocate memory. */
-  free(SA);
-  free(T);
+  if(fp != stdin) { fclose(fp); }
+  if(ofp != stdout) { fclose(ofp); }
 
   return 0;
 }
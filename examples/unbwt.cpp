@@ -24,183 +24,140 @@
  * OTHER DEALINGS IN THE SOFTWARE.
  */
 
-#if HAVE_CONFIG_H
-# include "config.hpp"
-#endif
-#include <stdio.h>
-#if HAVE_STRING_H
-# include <string.h>
-#endif
-#if HAVE_STDLIB_H
-# include <stdlib.h>
-#endif
-#if HAVE_MEMORY_H
-# include <memory.h>
-#endif
-#if HAVE_STDDEF_H
-# include <stddef.h>
-#endif
-#if HAVE_STRINGS_H
-# include <strings.h>
-#endif
-#if HAVE_SYS_TYPES_H
-# include <sys/types.h>
-#endif
-#if HAVE_IO_H && HAVE_FCNTL_H
-# include <io.h>
-# include <fcntl.h>
-#endif
-#include <time.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include <divsufsort.hpp>
+#include <parallel.hpp>
+#include <utils.hpp>
 
+/* Reads the output of bwt; see bwt.cpp for the format. */
 
-static
-size_t
-read_int(FILE *fp, saidx_t *n) {
+static bool read_int(FILE *fp, int32_t *n) {
   unsigned char c[4];
-  size_t m = fread(c, sizeof(unsigned char), 4, fp);
-  if(m == 4) {
-    *n = (c[0] <<  0) | (c[1] <<  8) |
-         (c[2] << 16) | (c[3] << 24);
-  }
-  return m;
+  if(fread(c, sizeof(unsigned char), 4, fp) != 4) { return false; }
+  *n = static_cast<int32_t>(static_cast<uint32_t>(c[0]) | (static_cast<uint32_t>(c[1]) << 8) |
+                            (static_cast<uint32_t>(c[2]) << 16) | (static_cast<uint32_t>(c[3]) << 24));
+  return true;
 }
 
-static
-void
-print_help(const char *progname, int status) {
-  fprintf(stderr,
-          "unbwt, an inverse burrows-wheeler transform program, version %s.\n",
-          divsufsort_version());
-  fprintf(stderr, "usage: %s INFILE OUTFILE\n\n", progname);
+static void print_help(const char *progname, int status) {
+  std::cerr << "unbwt, an inverse burrows-wheeler transform program, version " << divss::divsufsort_version() << ".\n";
+  std::cerr << "usage: " << progname << " [-t num] INFILE OUTFILE\n";
+  std::cerr << "  -t num    use num threads, 0 for all (default: 1); up to num blocks\n";
+  std::cerr << "            are decoded at once, and blocks written with primary\n";
+  std::cerr << "            indexes (bwt -i) by the threads left over\n\n";
   exit(status);
 }
 
-int
-main(int argc, const char *argv[]) {
+static void fail(const char *progname, const char *what, const char *fname) {
+  std::cerr << progname << ": " << what << " `" << fname << "': ";
+  perror(NULL);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, const char *argv[]) {
   FILE *fp, *ofp;
   const char *fname, *ofname;
-  sauchar_t *T;
-  saidx_t *A;
-  LFS_OFF_T n;
-  size_t m;
-  saidx_t pidx;
-  clock_t start, finish;
-  saint_t err, blocksize, needclose = 3;
+  int32_t blocksize, interval = 0;
+  unsigned threads = 1;
+  int64_t n = 0, size = -1;
+  int i = 1;
 
   /* Check arguments. */
   if((argc == 1) ||
      (strcmp(argv[1], "-h") == 0) ||
      (strcmp(argv[1], "--help") == 0)) { print_help(argv[0], EXIT_SUCCESS); }
-  if(argc != 3) { print_help(argv[0], EXIT_FAILURE); }
-
-  /* Open a file for reading. */
-  if(strcmp(argv[1], "-") != 0) {
-#if HAVE_FOPEN_S
-    if(fopen_s(&fp, fname = argv[1], "rb") != 0) {
-#else
-    if((fp = LFS_FOPEN(fname = argv[1], "rb")) == NULL) {
-#endif
-      fprintf(stderr, "%s: Cannot open file `%s': ", argv[0], fname);
-      perror(NULL);
-      exit(EXIT_FAILURE);
-    }
-  } else {
-#if HAVE__SETMODE && HAVE__FILENO
-    if(_setmode(_fileno(stdin), _O_BINARY) == -1) {
-      fprintf(stderr, "%s: Cannot set mode: ", argv[0]);
-      perror(NULL);
-      exit(EXIT_FAILURE);
-    }
-#endif
-    fp = stdin;
-    fname = "stdin";
-    needclose ^= 1;
+  if((argc == 5) && (strcmp(argv[1], "-t") == 0)) {
+    if((threads = static_cast<unsigned>(atoi(argv[2]))) == 0) { threads = std::thread::hardware_concurrency(); }
+    i += 2;
   }
-
-  /* Open a file for writing. */
-  if(strcmp(argv[2], "-") != 0) {
-#if HAVE_FOPEN_S
-    if(fopen_s(&ofp, ofname = argv[2], "wb") != 0) {
-#else
-    if((ofp = LFS_FOPEN(ofname = argv[2], "wb")) == NULL) {
-#endif
-      fprintf(stderr, "%s: Cannot open file `%s': ", argv[0], ofname);
-      perror(NULL);
-      exit(EXIT_FAILURE);
-    }
-  } else {
-#if HAVE__SETMODE && HAVE__FILENO
-    if(_setmode(_fileno(stdout), _O_BINARY) == -1) {
-      fprintf(stderr, "%s: Cannot set mode: ", argv[0]);
-      perror(NULL);
-      exit(EXIT_FAILURE);
-    }
-#endif
-    ofp = stdout;
-    ofname = "stdout";
-    needclose ^= 2;
+  if(i + 2 != argc) { print_help(argv[0], EXIT_FAILURE); }
+
+  /* Open the files; "-" stands for stdin and stdout. */
+  if(strcmp(fname = argv[i], "-") == 0) { fp = stdin, fname = "stdin"; }
+  else if((fp = fopen(fname, "rb")) == NULL) { fail(argv[0], "Cannot open file", fname); }
+  if(strcmp(ofname = argv[i + 1], "-") == 0) { ofp = stdout, ofname = "stdout"; }
+  else if((ofp = fopen(ofname, "wb")) == NULL) { fail(argv[0], "Cannot open file", ofname); }
+
+  /* Read the header. */
+  if(!read_int(fp, &blocksize)) { fail(argv[0], "Cannot read from", fname); }
+  if(blocksize < 0) {
+    blocksize &= INT32_C(0x7fffffff);
+    if(!read_int(fp, &interval) || (interval <= 0)) { fail(argv[0], "Cannot read from", fname); }
   }
 
-  /* Read the blocksize. */
-  if(read_int(fp, &blocksize) != 4) {
-    fprintf(stderr, "%s: Cannot read from `%s': ", argv[0], fname);
-    perror(NULL);
-    exit(EXIT_FAILURE);
+  /* Blocks are decoded by `workers` threads, each with its own buffers; the
+     threads left over go to the blocks themselves. */
+  unsigned workers = std::max(threads, 1u);
+  const int64_t header = (interval != 0) ? 8 : 4;
+  if((fp != stdin) && (fseeko(fp, 0, SEEK_END) == 0) && (0 <= (size = ftello(fp))) && (fseeko(fp, header, SEEK_SET) == 0)) {
+    const int64_t block = int64_t{blocksize} + 4;
+    workers = static_cast<unsigned>(std::min<int64_t>(workers, std::max<int64_t>((size - header + block - 1) / block, 1)));
   }
-
-  /* Allocate 5blocksize bytes of memory. */
-  T = (sauchar_t *)malloc(blocksize * sizeof(sauchar_t));
-  A = (saidx_t *)malloc(blocksize * sizeof(saidx_t));
-  if((T == NULL) || (A == NULL)) {
-    fprintf(stderr, "%s: Cannot allocate memory.\n", argv[0]);
-    exit(EXIT_FAILURE);
-  }
-
-  fprintf(stderr, "UnBWT (blocksize %" PRIdSAINT_T ") ... ", blocksize);
-  start = clock();
-  for(n = 0; (m = read_int(fp, &pidx)) != 0; n += m) {
-    /* Read blocksize bytes of data. */
-    if((m != 4) || ((m = fread(T, sizeof(sauchar_t), blocksize, fp)) == 0)) {
-      fprintf(stderr, "%s: %s `%s': ",
-        argv[0],
-        (ferror(fp) || !feof(fp)) ? "Cannot read from" : "Unexpected EOF in",
-        fname);
-      perror(NULL);
-      exit(EXIT_FAILURE);
+  const unsigned inner = std::max(threads / workers, 1u);
+
+  std::cerr << "UnBWT (blocksize " << blocksize << ", " << workers << " worker" << ((workers == 1) ? "" : "s") << ") ... ";
+  auto start = std::chrono::high_resolution_clock::now();
+  std::mutex input, output;
+  std::condition_variable turn;
+  int64_t next_block = 0, next_write = 0;
+  divss::internal::parallel_run(workers, [&](unsigned) {
+    std::vector<unsigned char> T(blocksize);
+    std::vector<int32_t> A(blocksize), indexes((interval != 0) ? (blocksize - 1) / interval + 1 : 0);
+    for(;;) {
+      /* Read the primary indexes of the next block and its data, in turn with
+         the other workers. */
+      int64_t block;
+      int32_t pidx, count = 0, err;
+      size_t m;
+      {
+        std::lock_guard<std::mutex> lock(input);
+        if(!read_int(fp, &pidx)) {
+          if(ferror(fp)) { fail(argv[0], "Cannot read from", fname); }
+          return;
+        }
+        bool ok = (interval == 0) || (read_int(fp, &count) && (0 <= count) && (static_cast<size_t>(count) < indexes.size()));
+        for(int32_t k = 1; ok && (k <= count); ++k) { ok = read_int(fp, &indexes[k]); }
+        if(!ok || ((m = fread(T.data(), sizeof(unsigned char), blocksize, fp)) == 0)) {
+          fail(argv[0], (ferror(fp) || !feof(fp)) ? "Cannot read from" : "Unexpected EOF in", fname);
+        }
+        block = next_block++, n += static_cast<int64_t>(m);
+      }
+      if((interval != 0) && (static_cast<size_t>(count) != (m - 1) / interval)) {
+        std::cerr << argv[0] << ": Invalid data.\n";
+        exit(EXIT_FAILURE);
+      }
+      if(interval != 0) { indexes[0] = pidx; }
+
+      /* Inverse Burrows-Wheeler Transform. */
+      if((err = inverse_bw_transform(T.data(), T.data(), A.data(), static_cast<int32_t>(m), pidx,
+                                     (interval != 0) ? indexes.data() : static_cast<const int32_t *>(nullptr), interval, inner)) != 0) {
+        std::cerr << argv[0] << " (inverse_bw_transform): " << ((err == -1) ? "Invalid data" : "Cannot allocate memory") << ".\n";
+        exit(EXIT_FAILURE);
+      }
+
+      /* Write m bytes of data once the blocks before it are written. */
+      std::unique_lock<std::mutex> lock(output);
+      turn.wait(lock, [&]() { return next_write == block; });
+      if(fwrite(T.data(), sizeof(unsigned char), m, ofp) != m) { fail(argv[0], "Cannot write to", ofname); }
+      ++next_write;
+      lock.unlock();
+      turn.notify_all();
     }
-
-    /* Inverse Burrows-Wheeler Transform. */
-    if((err = inverse_bw_transform(T, T, A, m, pidx)) != 0) {
-      fprintf(stderr, "%s (reverseBWT): %s.\n",
-        argv[0],
-        (err == -1) ? "Invalid data" : "Cannot allocate memory");
-      exit(EXIT_FAILURE);
-    }
-
-    /* Write m bytes of data. */
-    if(fwrite(T, sizeof(sauchar_t), m, ofp) != m) {
-      fprintf(stderr, "%s: Cannot write to `%s': ", argv[0], ofname);
-      perror(NULL);
-      exit(EXIT_FAILURE);
-    }
-  }
-  if(ferror(fp)) {
-    fprintf(stderr, "%s: Cannot read from `%s': ", argv[0], fname);
-    perror(NULL);
-    exit(EXIT_FAILURE);
-  }
-  finish = clock();
-  fprintf(stderr, "%" PRIdOFF_T " bytes: %.4f sec\n",
-    n, (double)(finish - start) / (double)CLOCKS_PER_SEC);
+  });
+  auto finish = std::chrono::high_resolution_clock::now();
+  std::cerr << n << " bytes: " << std::chrono::duration_cast<std::chrono::milliseconds>(finish - start).count() << " ms\n";
 
   /* Close files */
-  if(needclose & 1) { fclose(fp); }
-  if(needclose & 2) { fclose(ofp); }
-
-  /* Deallocate memory. */
-  free(A);
-  free(T);
+  if(fp != stdin) { fclose(fp); }
+  if(ofp != stdout) { fclose(ofp); }
 
   return 0;
 }
@@ -8,10 +8,35 @@
 #include <cassert>
 #include <cstddef>
 #include <tuple>
+#include "int40.hpp"
 
 #define SS_INSERTIONSORT_THRESHOLD (8)
 #define SS_BLOCKSIZE (1024)
+#define SS_PARALLEL_BLOCKSIZE (16 * SS_BLOCKSIZE)
+#ifndef SS_CACHED_KEYS
+#define SS_CACHED_KEYS (0) /* 1 sorts B* blocks on cached keys of SS_KEY_SYMBOLS symbols */
+#endif
+#define SS_KEY_SYMBOLS (7) /* 9 bits each */
+#define SS_KEY_PREFETCH (8)
+#ifndef SS_RADIX_THRESHOLD
+#define SS_RADIX_THRESHOLD (SS_BLOCKSIZE) /* 0 disables the radix pass over the type B* buckets */
+#endif
+#ifndef SS_RADIX_DEPTH
+#define SS_RADIX_DEPTH (4) /* depth at which the radix pass hands buckets to sssort */
+#endif
 #define TR_INSERTIONSORT_THRESHOLD (8)
+#define INDUCE_BLOCKSIZE (16384)
+#define CLASSIFY_BLOCKSIZE (65536)
+#define IBWT_CHAINS (16)
+#ifndef IBWT_MIN_SEGMENT
+#define IBWT_MIN_SEGMENT (16384) /* fewest symbols per thread for the parallel inverse BWT */
+#endif
+#ifndef COMPACT_SIGMA_MAX
+#define COMPACT_SIGMA_MAX (128) /* 0 disables the alphabet compaction */
+#endif
+#ifndef COMPACT_N_MAX
+#define COMPACT_N_MAX (1 << 18) /* longest text compacted; the copy does not pay off beyond */
+#endif
 
 
 constexpr size_t log2(size_t n)
@@ -25,7 +50,7 @@ constexpr size_t log2(size_t n)
 
 template <typename T> static constexpr size_t min_stack_size() {
 	/* minstacksize = log(SS_BLOCKSIZE) / log(3) * 2 */
-	if (sizeof(T) == 8) {
+	if (4 < sizeof(T)) {
 		return 96;
 	} else {
 		return 64;
@@ -74,6 +99,10 @@ template <> constexpr std::size_t alphabet_size<std::byte> = std::numeric_limits
 template <typename CharT> constexpr std::size_t bucket_A_size = alphabet_size<CharT>;
 template <typename CharT> constexpr std::size_t bucket_B_size = alphabet_size<CharT> * alphabet_size<CharT>;
 
+/* Symbol types whose bucket tables cannot be allocated; these are sorted by
+   the large-alphabet engine. */
+template <typename CharT> constexpr bool large_alphabet = (sizeof(CharT) > 1);
+
 template <typename T, std::size_t N> struct static_stack {
 	std::array<T, N> data{};
 	std::size_t usage = 0;
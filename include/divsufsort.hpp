@@ -24,52 +24,439 @@
  * OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#ifndef LIBDIVSUFSORT_DIVSUFSORT_HPP
+#define LIBDIVSUFSORT_DIVSUFSORT_HPP
+
 #include "sssort.hpp"
 #include "trsort.hpp"
+#include "parallel.hpp"
+#include "sais.hpp"
+#include "lcp.hpp"
+#include <algorithm>
+#include <bit>
+#include <memory>
+#include <new>
 #include <span>
+#include <system_error>
+#include <type_traits>
 #include <vector>
-#ifdef _OPENMP
-# include <omp.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
 #endif
 
 namespace divss::internal {
 /*- Private Functions -*/
 
-#define SUFS_BUCKET_B(_c0, _c1) (bucket_B[(_c1) * alphabet_size<CharT> + (_c0)])
-#define SUFS_BUCKET_BSTAR(_c0, _c1) (bucket_B[(_c0) * alphabet_size<CharT> + (_c1)])
+#define SUFS_BUCKET_B(_c0, _c1) (bucket_B[(_c1) * sigma + (_c0)])
+#define SUFS_BUCKET_BSTAR(_c0, _c1) (bucket_B[(_c0) * sigma + (_c1)])
 
-/* Sorts suffixes of type B*. */
-template <typename CharT = unsigned char, typename ResultT = int32_t> static ResultT sort_typeBstar(const CharT *T, ResultT *SA, ResultT *bucket_A, ResultT *bucket_B, ResultT n) noexcept {
-  ResultT *PAb, *ISAb, *buf;
-#ifdef _OPENMP
-  ResultT *curbuf;
-  ResultT l;
+/* Splits the type B* suffixes in [first, last), which share their first
+   depth symbols, by the symbol at depth with an in-place MSD radix pass
+   (American flag sort) while more than SS_RADIX_THRESHOLD of them remain
+   and depth is below SS_RADIX_DEPTH, and hands the parts left to sort(first,
+   last, depth, lastsuffix). Substrings whose last symbol is at depth are
+   equal and marked as sssort marks them. lastsuffix tells that *first is the
+   last type B* suffix, which is kept at the front of its part as sssort
+   expects. The keys are held in buf; without room for them the range is
+   sorted as a whole. */
+template <typename CharT = unsigned char, typename ResultT = int32_t, typename SortFn> static void bstar_radixsort(const CharT *T, const ResultT *PAb, ResultT *first, ResultT *last, ResultT *buf, ResultT bufsize, ResultT depth, ResultT n, ResultT m, int32_t sigma, int32_t lastsuffix, SortFn && sort) {
+  if constexpr(large_alphabet<CharT>) {
+    sort(first, last, depth, lastsuffix);
+    return;
+  }
+  std::array<ResultT, large_alphabet<CharT> ? 1 : 2 * alphabet_size<CharT> + 2> next;
+  std::array<ResultT, large_alphabet<CharT> ? 1 : 2 * alphabet_size<CharT> + 2> bound;
+  uint16_t *K;
+  void *vp = buf;
+  std::size_t space = (0 < bufsize) ? static_cast<std::size_t>(bufsize) * sizeof(ResultT) : 0;
+  ResultT *a, *b;
+  ResultT i, j, p, s, t, size;
+  int32_t c, k, kl = 0, kmax = 2 * sigma + 1;
+  uint16_t u;
+
+  size = last - first;
+  if((SS_RADIX_THRESHOLD == 0) || (size <= SS_RADIX_THRESHOLD) || (SS_RADIX_DEPTH <= depth) ||
+     (std::align(alignof(uint16_t), static_cast<std::size_t>(size) * sizeof(uint16_t), vp, space) == nullptr)) {
+    sort(first, last, depth, lastsuffix);
+    return;
+  }
+  K = static_cast<uint16_t *>(vp);
+
+  /* Key of each suffix: 0 past the end of its substring, 2c + 1 for a last
+     symbol c and 2c + 2 for any other. */
+  std::fill_n(bound.begin(), kmax + 1, 0);
+  for(i = 0; i < size; ++i) {
+    if((i + 2 * SS_KEY_PREFETCH) < size) { __builtin_prefetch(&PAb[first[i + 2 * SS_KEY_PREFETCH]]); }
+    if((i + SS_KEY_PREFETCH) < size) { __builtin_prefetch(&T[PAb[first[i + SS_KEY_PREFETCH]] + depth]); }
+    p = static_cast<ResultT>(PAb[first[i]] + depth);
+    t = (first[i] == (m - 1)) ? static_cast<ResultT>(n) : static_cast<ResultT>(PAb[first[i] + 1] + 2);
+    K[i] = static_cast<uint16_t>((p < t) ? 2 * static_cast<int32_t>(T[p]) + (((p + 1) < t) ? 2 : 1) : 0);
+    ++bound[K[i]];
+  }
+  if(lastsuffix != 0) { kl = K[0]; }
+  for(k = 0, s = 0; k <= kmax; ++k) { next[k] = s; s += bound[k]; bound[k] = s; }
+
+  /* Move each suffix to its part, one cycle at a time. */
+  for(k = 0; k <= kmax; ++k) {
+    for(; next[k] < bound[k]; ++next[k]) {
+      for(t = first[next[k]], u = K[next[k]]; u != k; ) {
+        j = next[u]++;
+        std::swap(t, first[j]), std::swap(u, K[j]);
+      }
+      first[next[k]] = t, K[next[k]] = u;
+    }
+  }
+
+  for(k = 0, s = 0; k <= kmax; s = bound[k++]) {
+    a = first + s, b = first + bound[k];
+    if((b - a) < 2) { continue; }
+    c = ((lastsuffix != 0) && (k == kl)) ? 1 : 0;
+    if(c != 0) {
+      for(ResultT *e = a; e < b; ++e) {
+        if(*e == (m - 1)) { std::swap(*e, *a); break; }
+      }
+    }
+    if((k & 1) != 0) {
+      for(ResultT *e = a + c + 1; e < b; ++e) { *e = ~*e; }
+    } else {
+      bstar_radixsort<CharT, ResultT>(T, PAb, a, b, buf, bufsize, depth + 1, n, m, sigma, c, sort);
+    }
+  }
+}
+
+/* Sorts the type B* substrings of all buckets using several threads.
+   Large buckets are first split on their next symbols by bstar_radixsort,
+   one bucket per thread. The parts are handed out largest first through an
+   atomic cursor, parts bigger than a fair share are cut into sub-ranges
+   which are sorted independently and then merged pairwise with
+   ss_swapmerge, each merge being split by ss_splitmerge into independent
+   ones while there are fewer merges than threads. */
+template <typename CharT = unsigned char, typename ResultT = int32_t> static void sort_typeBstar_parallel(const CharT *T, const ResultT *PAb, ResultT *SA, ResultT *bucket_B, ResultT *buf, ResultT bufsize, ResultT n, ResultT m, unsigned threads, int32_t sigma) {
+  struct task_type {
+    ResultT *first;
+    ResultT *last;
+    ResultT depth;
+    int32_t lastsuffix;
+  };
+  struct split_type {
+    ResultT *first;
+    ResultT *last;
+    ResultT parts;
+    ResultT width;
+    ResultT depth;
+    int32_t lastsuffix;
+  };
+  struct merge_type {
+    ResultT *first;
+    ResultT *middle;
+    ResultT *last;
+    ResultT depth;
+  };
+  std::vector<task_type> buckets;
+  std::vector<std::vector<task_type>> found(threads);
+  std::vector<task_type> tasks;
+  std::vector<split_type> splits;
+  std::vector<merge_type> merges;
+  std::vector<std::vector<merge_type>> found_merges(threads);
+  ResultT i, j, l, p, parts, limit, curbufsize;
+  int32_t c0, c1;
+
+  curbufsize = bufsize / static_cast<ResultT>(threads);
+  limit = std::max<ResultT>(m / static_cast<ResultT>(threads), SS_PARALLEL_BLOCKSIZE);
+
+  /* Collect the buckets and split the large ones on their next symbols. */
+  for(c0 = sigma - 2, j = m; 0 < j; --c0) {
+    for(c1 = sigma - 1; c0 < c1; j = i, --c1) {
+      i = SUFS_BUCKET_BSTAR(c0, c1);
+      if(1 < (j - i)) { buckets.push_back({SA + i, SA + j, 2, *(SA + i) == (m - 1)}); }
+    }
+  }
+  std::sort(buckets.begin(), buckets.end(), [](const task_type & a, const task_type & b) { return (a.last - a.first) > (b.last - b.first); });
+  parallel_for(threads, buckets.size(), [&](std::size_t idx, unsigned tid) {
+    const task_type & bucket = buckets[idx];
+    bstar_radixsort<CharT, ResultT>(T, PAb, bucket.first, bucket.last, buf + tid * curbufsize, curbufsize, bucket.depth, n, m, sigma, bucket.lastsuffix,
+                                    [&](ResultT *first, ResultT *last, ResultT depth, int32_t lastsuffix) { found[tid].push_back({first, last, depth, lastsuffix}); });
+  });
+
+  /* Cut the oversized parts into sub-ranges. */
+  for(const std::vector<task_type> & list: found) {
+    for(const task_type & task: list) {
+      l = static_cast<ResultT>(task.last - task.first) - task.lastsuffix;
+      parts = std::min<ResultT>(static_cast<ResultT>(threads), l / SS_PARALLEL_BLOCKSIZE);
+      if((l <= limit) || (parts < 2) || (curbufsize < SS_BLOCKSIZE)) {
+        tasks.push_back(task);
+        continue;
+      }
+      ResultT *first = task.first + task.lastsuffix;
+      splits.push_back({first, task.last, parts, l / parts, task.depth, task.lastsuffix});
+      for(p = 0; p < parts; ++p) {
+        tasks.push_back({first + p * (l / parts), (p == (parts - 1)) ? task.last : first + (p + 1) * (l / parts), task.depth, 0});
+      }
+    }
+  }
+
+  /* Sort the parts and the sub-ranges, largest first. */
+  std::sort(tasks.begin(), tasks.end(), [](const task_type & a, const task_type & b) { return (a.last - a.first) > (b.last - b.first); });
+  parallel_for(threads, tasks.size(), [&](std::size_t idx, unsigned tid) {
+    const task_type & task = tasks[idx];
+    sssort<CharT, ResultT>(T, PAb, task.first, task.last, buf + tid * curbufsize, curbufsize, task.depth, n, task.lastsuffix);
+  });
+
+  /* Merge the sorted sub-ranges of the split parts, one level at a time. */
+  for(ResultT step = 1;; step <<= 1) {
+    merges.clear();
+    for(const split_type & split: splits) {
+      for(p = 0; (p + step) < split.parts; p += 2 * step) {
+        merges.push_back({split.first + p * split.width,
+                          split.first + (p + step) * split.width,
+                          ((p + 2 * step) < split.parts) ? split.first + (p + 2 * step) * split.width : split.last,
+                          split.depth});
+      }
+    }
+    if(merges.empty()) { break; }
+
+    /* Split the merges of the level until there are enough to keep every
+       thread busy, the top one in particular. */
+    parts = (static_cast<ResultT>(threads) + static_cast<ResultT>(merges.size()) - 1) / static_cast<ResultT>(merges.size());
+    parallel_for(threads, merges.size(), [&](std::size_t idx, unsigned tid) {
+      std::vector<std::pair<merge_type, ResultT>> stack{{merges[idx], parts}};
+      while(!stack.empty()) {
+        auto [merge, k] = stack.back();
+        stack.pop_back();
+        if((1 < k) && (2 * SS_PARALLEL_BLOCKSIZE <= (merge.last - merge.first)) && (merge.first < merge.middle) && (merge.middle < merge.last)) {
+          ResultT *lmiddle, *rmiddle;
+          ResultT *mid = ss_splitmerge<CharT, ResultT>(T, PAb, merge.first, merge.middle, merge.last, merge.depth, &lmiddle, &rmiddle);
+          if((merge.first < mid) && (mid < merge.last)) {
+            stack.push_back({{merge.first, lmiddle, mid, merge.depth}, k / 2});
+            stack.push_back({{mid, rmiddle, merge.last, merge.depth}, k - k / 2});
+            continue;
+          }
+        }
+        found_merges[tid].push_back(merge);
+      }
+    });
+    merges.clear();
+    for(std::vector<merge_type> & list: found_merges) {
+      merges.insert(merges.end(), list.begin(), list.end());
+      list.clear();
+    }
+    std::sort(merges.begin(), merges.end(), [](const merge_type & a, const merge_type & b) { return (a.last - a.first) > (b.last - b.first); });
+    parallel_for(threads, merges.size(), [&](std::size_t idx, unsigned tid) {
+      const merge_type & merge = merges[idx];
+      if((merge.first < merge.middle) && (merge.middle < merge.last)) {
+        ss_swapmerge<CharT, ResultT>(T, PAb, merge.first, merge.middle, merge.last,
+                                     buf + tid * curbufsize, curbufsize, merge.depth);
+      }
+    });
+  }
+
+  /* Insert the last type B* suffix into its split part. */
+  for(const split_type & split: splits) {
+    if(split.lastsuffix != 0) { ss_insert_lastsuffix<CharT, ResultT>(T, PAb, split.first, split.last, split.depth, n); }
+  }
+}
+
+/* Compares T[i] with T[i + 1] for the 64 positions i = base .. base + 63 and
+   sets the bits of the positions with T[i] < T[i + 1] in lt and of those with
+   T[i] == T[i + 1] in eq. Positions from n - 1 on are left clear. */
+template <typename CharT = unsigned char, typename ResultT = int32_t> static inline void classify_word(const CharT *T, ResultT base, ResultT n, uint64_t & lt, uint64_t & eq) noexcept {
+  ResultT i, last;
+
+  lt = 0, eq = 0;
+#if defined(__SSE2__)
+  if constexpr((sizeof(CharT) == 1) && std::is_unsigned_v<CharT>) {
+    if((base + 64) < n) {
+      const unsigned char *U = reinterpret_cast<const unsigned char *>(T + base);
+#if defined(__AVX2__)
+      const __m256i flip = _mm256_set1_epi8(static_cast<char>(0x80));
+      for(int k = 0; k < 64; k += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(U + k));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(U + k + 1));
+        eq |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b)))) << k;
+        lt |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpgt_epi8(_mm256_xor_si256(b, flip), _mm256_xor_si256(a, flip))))) << k;
+      }
+#else
+      const __m128i flip = _mm_set1_epi8(static_cast<char>(0x80));
+      for(int k = 0; k < 64; k += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(U + k));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(U + k + 1));
+        eq |= static_cast<uint64_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(a, b))) << k;
+        lt |= static_cast<uint64_t>(_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_xor_si128(b, flip), _mm_xor_si128(a, flip)))) << k;
+      }
+#endif
+      return;
+    }
+  }
 #endif
+  for(i = base, last = std::min<ResultT>(base + 64, n - 1); i < last; ++i) {
+    lt |= static_cast<uint64_t>(T[i] < T[i + 1]) << (i - base);
+    eq |= static_cast<uint64_t>(T[i] == T[i + 1]) << (i - base);
+  }
+}
+
+/* Returns the type B bits of a word classified by classify_word. carry tells
+   whether the position following the word is of type B; a run of equal
+   characters takes the type of the position after it. */
+static inline uint64_t classify_typeB(uint64_t lt, uint64_t eq, uint64_t carry) noexcept {
+  uint64_t g = lt | (eq & (carry << 63)), p = eq;
+  g |= p & (g >> 1);  p &= p >> 1;
+  g |= p & (g >> 2);  p &= p >> 2;
+  g |= p & (g >> 4);  p &= p >> 4;
+  g |= p & (g >> 8);  p &= p >> 8;
+  g |= p & (g >> 16); p &= p >> 16;
+  g |= p & (g >> 32);
+  return g;
+}
+
+/* Counts the type A, B and B* suffixes like the first pass of sort_typeBstar
+   using several threads, and stores the beginning positions of the type B*
+   suffixes into SA[n - m .. n). The text is cut into one chunk per thread;
+   each thread classifies its chunk 64 positions at a time into private
+   buckets and a type B* bitmap. Returns m. */
+template <typename CharT = unsigned char, typename ResultT = int32_t> static ResultT count_typeBstar_parallel(const CharT *T, ResultT *SA, ResultT *bucket_A, ResultT *bucket_B, ResultT n, unsigned threads, int32_t sigma) {
+  const std::size_t size_A = static_cast<std::size_t>(sigma), size_B = size_A * size_A;
+  const std::size_t words = (static_cast<std::size_t>(n) + 63) / 64;
+  std::vector<uint64_t> bstar(words);
+  std::vector<ResultT> bounds(threads + 1), counts(threads + 1), local((size_A + size_B) * threads);
+  std::vector<uint64_t> carries(threads);
+  ResultT i, e, m;
+  unsigned t;
+
+  for(t = 0; t <= threads; ++t) {
+    bounds[t] = static_cast<ResultT>(std::min<std::size_t>(n, words * t / threads * 64));
+  }
+
+  /* Resolve the type of the position following each chunk, right to left. */
+  for(t = threads - 1; 0 < t--;) {
+    for(i = bounds[t + 1], e = bounds[t + 2]; ((i + 1) < e) && (T[i] == T[i + 1]); ++i) { }
+    if((i + 1) < e) { carries[t] = T[i] < T[i + 1]; }
+    else if(e == n) { carries[t] = 0; }
+    else if(T[i] == T[e]) { carries[t] = carries[t + 1]; }
+    else { carries[t] = T[i] < T[e]; }
+  }
+  carries[threads - 1] = 0;
+
+  /* Classify and count. */
+  parallel_run(threads, [&](unsigned tid) {
+    ResultT *A = local.data() + (size_A + size_B) * tid, *B = A + size_A;
+    ResultT base, p, last, count = 0;
+    uint64_t lt, eq, typeB, bits, carry = carries[tid];
+    std::size_t w;
+    int32_t c0, c1;
+
+    for(w = (static_cast<std::size_t>(bounds[tid + 1]) + 63) / 64; (static_cast<std::size_t>(bounds[tid]) / 64) < w;) {
+      base = static_cast<ResultT>(--w * 64);
+      classify_word<CharT, ResultT>(T, base, n, lt, eq);
+      typeB = classify_typeB(lt, eq, carry);
+      bits = bstar[w] = typeB & ~((typeB >> 1) | (carry << 63));
+      count += static_cast<ResultT>(std::popcount(bits));
+      carry = typeB & 1;
+      for(p = base, last = std::min<ResultT>(base + 64, n); p < last; ++p, typeB >>= 1, bits >>= 1) {
+        c0 = T[p];
+        if((typeB & 1) == 0) { ++A[c0]; continue; }
+        c1 = T[p + 1];
+        if((bits & 1) != 0) { ++B[c0 * sigma + c1]; }
+        else { ++B[c1 * sigma + c0]; }
+      }
+    }
+    counts[tid + 1] = count;
+  });
+
+  for(t = 0; t < threads; ++t) { counts[t + 1] += counts[t]; }
+  m = counts[threads];
+
+  /* Sum the buckets and store the type B* positions. */
+  parallel_run(threads, [&](unsigned tid) {
+    const std::size_t size = size_A + size_B;
+    std::size_t c, w, first = size * tid / threads, last = size * (tid + 1) / threads;
+    ResultT *dst = SA + n - m + counts[tid];
+    uint64_t bits;
+
+    for(c = first; c < last; ++c) {
+      ResultT sum = 0;
+      for(unsigned s = 0; s < threads; ++s) { sum += local[size * s + c]; }
+      if(c < size_A) { bucket_A[c] += sum; }
+      else { bucket_B[c - size_A] += sum; }
+    }
+    for(w = static_cast<std::size_t>(bounds[tid]) / 64; w < (static_cast<std::size_t>(bounds[tid + 1]) + 63) / 64; ++w) {
+      for(bits = bstar[w]; bits != 0; bits &= bits - 1) {
+        *dst++ = static_cast<ResultT>(w * 64 + std::countr_zero(bits));
+      }
+    }
+  });
+
+  return m;
+}
+
+/* Computes LCP[r], the LCP of the type B* suffixes of ranks r - 1 and r
+   (LCP[0] = 0). SA[0..m-1] holds the sorted type B* suffixes, ISAb their
+   ranks in text order and LCP[m..2m-1] their positions in text order. As in
+   the Phi algorithm, if the type B* suffix p shares h characters with its
+   predecessor q, the next one p + d shares at least h - d with its own, since
+   q + d is a type B* suffix too. That fails only when the run of T[p + d + 1]
+   reaches the end of the common prefix; such runs start right after distinct
+   type B* suffixes and do not overlap, so the whole pass is O(n). The
+   predecessors LCP_PREFETCH suffixes ahead are prefetched. */
+template <typename CharT, typename ResultT> static void lcp_typeBstar(const CharT *T, const ResultT *SA, const ResultT *ISAb, ResultT *LCP, ResultT n, ResultT m) noexcept {
+  ResultT k, p, q, r, d, h, x;
+
+  for(k = 0, h = 0; k < m; ++k) {
+    if(k + 2 * LCP_PREFETCH < m) {
+      __builtin_prefetch(&SA[std::max<ResultT>(ISAb[k + 2 * LCP_PREFETCH] - 1, 0)]);
+      if((q = SA[std::max<ResultT>(ISAb[k + LCP_PREFETCH] - 1, 0)]) < 0) { q = ~q; }
+      __builtin_prefetch(&T[q]), __builtin_prefetch(&LCP[ISAb[k + LCP_PREFETCH]], 1);
+    }
+    p = LCP[m + k];
+    if((r = ISAb[k]) == 0) {
+      LCP[0] = 0, h = 0;
+    } else {
+      if((q = SA[r - 1]) < 0) { q = ~q; }
+      for(; (p + h < n) && (q + h < n) && (T[p + h] == T[q + h]); ++h) { }
+      LCP[r] = h;
+    }
+    if(k + 1 < m) {
+      d = LCP[m + k + 1] - p;
+      if(h < d + 2) {
+        h = 0;
+      } else {
+        for(x = p + d + 2; (x < p + h) && (T[x] == T[p + d + 1]); ++x) { }
+        h = (x < p + h) ? h - d : 0;
+      }
+    }
+  }
+}
+
+/* Sorts suffixes of type B*. When LCP is not null, LCP[i] also receives the
+   LCP of the type B* suffix SA[i] and the preceding type B* suffix.
+   work[0..worksize-1], when larger, replaces the free part of SA as the
+   buffer of sssort and of trsort. */
+template <typename CharT = unsigned char, typename ResultT = int32_t> static ResultT sort_typeBstar(const CharT *T, ResultT *SA, ResultT *bucket_A, ResultT *bucket_B, ResultT n, unsigned threads = 1, int32_t sigma = static_cast<int32_t>(alphabet_size<CharT>), ResultT *LCP = nullptr, ResultT *work = nullptr, ResultT worksize = 0) {
+  ResultT *PAb, *ISAb, *buf;
   ResultT i, j, k, t, m, bufsize;
   int32_t c0, c1;
-#ifdef _OPENMP
-  int32_t d0, d1;
-  int tmp;
-#endif
   // expects both buckets to be zero-initialized
 
   /* Count the number of occurrences of the first one or two characters of each
      type A, B and B* suffix. Moreover, store the beginning position of all
      type B* suffixes into the array SA. */
-  for(i = n - 1, m = n, c0 = T[n - 1]; 0 <= i;) {
-    /* type A suffix. */
-    do { ++bucket_A[c1 = c0]; } while((0 <= --i) && ((c0 = T[i]) >= c1));
-    if(0 <= i) {
-      /* type B* suffix. */
-      ++SUFS_BUCKET_BSTAR(c0, c1);
-      SA[--m] = i;
-      /* type B suffix. */
-      for(--i, c1 = c0; (0 <= i) && ((c0 = T[i]) <= c1); --i, c1 = c0) {
-        ++SUFS_BUCKET_B(c0, c1);
+  if((1 < threads) && (static_cast<std::size_t>(threads) * CLASSIFY_BLOCKSIZE < static_cast<std::size_t>(n))) {
+    m = count_typeBstar_parallel<CharT, ResultT>(T, SA, bucket_A, bucket_B, n, threads, sigma);
+  } else {
+    for(i = n - 1, m = n, c0 = T[n - 1]; 0 <= i;) {
+      /* type A suffix. */
+      do { ++bucket_A[c1 = c0]; } while((0 <= --i) && ((c0 = T[i]) >= c1));
+      if(0 <= i) {
+        /* type B* suffix. */
+        ++SUFS_BUCKET_BSTAR(c0, c1);
+        SA[--m] = i;
+        /* type B suffix. */
+        for(--i, c1 = c0; (0 <= i) && ((c0 = T[i]) <= c1); --i, c1 = c0) {
+          ++SUFS_BUCKET_B(c0, c1);
+        }
       }
     }
+    m = n - m;
   }
-  m = n - m;
 	/*
 	note:
 	  A type B* suffix is lexicographically smaller than a type B suffix that
@@ -77,11 +464,11 @@ template <typename CharT = unsigned char, typename ResultT = int32_t> static Res
 	*/
 
   /* Calculate the index of start/end point of each bucket. */
-  for(c0 = 0, i = 0, j = 0; c0 < static_cast<int32_t>(alphabet_size<CharT>); ++c0) {
+  for(c0 = 0, i = 0, j = 0; c0 < sigma; ++c0) {
     t = i + bucket_A[c0];
     bucket_A[c0] = i + j; /* start point */
     i = t + SUFS_BUCKET_B(c0, c0);
-    for(c1 = c0 + 1; c1 < static_cast<int32_t>(alphabet_size<CharT>); ++c1) {
+    for(c1 = c0 + 1; c1 < sigma; ++c1) {
       j += SUFS_BUCKET_BSTAR(c0, c1);
       SUFS_BUCKET_BSTAR(c0, c1) = j; /* end point */
       i += SUFS_BUCKET_B(c0, c1);
@@ -99,46 +486,23 @@ template <typename CharT = unsigned char, typename ResultT = int32_t> static Res
     SA[--SUFS_BUCKET_BSTAR(c0, c1)] = m - 1;
 
     /* Sort the type B* substrings using sssort. */
-#ifdef _OPENMP
-    tmp = omp_get_max_threads();
-    buf = SA + m, bufsize = (n - (2 * m)) / tmp;
-    c0 = alphabet_size<CharT> - 2, c1 = alphabet_size<CharT> - 1, j = m;
-#pragma omp parallel default(shared) private(curbuf, k, l, d0, d1, tmp)
-    {
-      tmp = omp_get_thread_num();
-      curbuf = buf + tmp * bufsize;
-      k = 0;
-      for(;;) {
-        #pragma omp critical(sssort_lock)
-        {
-          if(0 < (l = j)) {
-            d0 = c0, d1 = c1;
-            do {
-              k = SUFS_BUCKET_BSTAR(d0, d1);
-              if(--d1 <= d0) {
-                d1 = alphabet_size<CharT> - 1;
-                if(--d0 < 0) { break; }
-              }
-            } while(((l - k) <= 1) && (0 < (l = k)));
-            c0 = d0, c1 = d1, j = k;
-          }
-        }
-        if(l == 0) { break; }
-        sssort(T, PAb, SA + k, SA + l,
-               curbuf, bufsize, 2, n, *(SA + k) == (m - 1));
-      }
-    }
-#else
     buf = SA + m, bufsize = n - (2 * m);
-    for(c0 = alphabet_size<CharT> - 2, j = m; 0 < j; --c0) {
-      for(c1 = alphabet_size<CharT> - 1; c0 < c1; j = i, --c1) {
-        i = SUFS_BUCKET_BSTAR(c0, c1);
-        if(1 < (j - i)) {
-          sssort<CharT, ResultT>(T, PAb, SA + i, SA + j, buf, bufsize, 2, n, *(SA + i) == (m - 1));
+    if((work != nullptr) && (bufsize < worksize)) { buf = work, bufsize = worksize; }
+    if(1 < threads) {
+      sort_typeBstar_parallel<CharT, ResultT>(T, PAb, SA, bucket_B, buf, bufsize, n, m, threads, sigma);
+    } else {
+      for(c0 = sigma - 2, j = m; 0 < j; --c0) {
+        for(c1 = sigma - 1; c0 < c1; j = i, --c1) {
+          i = SUFS_BUCKET_BSTAR(c0, c1);
+          if(1 < (j - i)) {
+            bstar_radixsort<CharT, ResultT>(T, PAb, SA + i, SA + j, buf, bufsize, 2, n, m, sigma, *(SA + i) == (m - 1),
+                                            [&](ResultT *first, ResultT *last, ResultT depth, int32_t lastsuffix) {
+                                              sssort<CharT, ResultT>(T, PAb, first, last, buf, bufsize, depth, n, lastsuffix);
+                                            });
+          }
         }
       }
     }
-#endif
 
     /* Compute ranks of type B* substrings. */
     for(i = m - 1; 0 <= i; --i) {
@@ -154,7 +518,8 @@ template <typename CharT = unsigned char, typename ResultT = int32_t> static Res
     }
 
     /* Construct the inverse suffix array of type B* suffixes using trsort. */
-    trsort<ResultT>(ISAb, SA, m, 1);
+    if((work != nullptr) && ((n - 2 * m) < worksize)) { trsort<ResultT>(ISAb, SA, m, 1, threads, work, worksize); }
+    else { trsort<ResultT>(ISAb, SA, m, 1, threads, SA + 2 * m, n - 2 * m); }
 
     /* Set the sorted order of tyoe B* suffixes. */
     for(i = n - 1, j = m, c0 = T[n - 1]; 0 <= i;) {
@@ -162,22 +527,27 @@ template <typename CharT = unsigned char, typename ResultT = int32_t> static Res
       if(0 <= i) {
         t = i;
         for(--i, c1 = c0; (0 <= i) && ((c0 = T[i]) <= c1); --i, c1 = c0) { }
-        SA[ISAb[--j]] = ((t == 0) || (1 < (t - i))) ? t : ~t;
+        SA[ISAb[--j]] = ((t == 0) || (1 < (t - i))) ? t : static_cast<ResultT>(~t);
+        if(LCP != nullptr) { LCP[m + j] = t; }
       }
     }
+    if(LCP != nullptr) { lcp_typeBstar(T, SA, ISAb, LCP, n, m); }
 
     /* Calculate the index of start/end point of each bucket. */
-    SUFS_BUCKET_B(alphabet_size<CharT> - 1, alphabet_size<CharT> - 1) = n; /* end point */
-    for(c0 = alphabet_size<CharT> - 2, k = m - 1; 0 <= c0; --c0) {
+    SUFS_BUCKET_B(sigma - 1, sigma - 1) = n; /* end point */
+    for(c0 = sigma - 2, k = m - 1; 0 <= c0; --c0) {
       i = bucket_A[c0 + 1] - 1;
-      for(c1 = alphabet_size<CharT> - 1; c0 < c1; --c1) {
+      for(c1 = sigma - 1; c0 < c1; --c1) {
         t = i - SUFS_BUCKET_B(c0, c1);
         SUFS_BUCKET_B(c0, c1) = i; /* end point */
 
         /* Move all type B* suffixes to the correct position. */
         for(i = t, j = SUFS_BUCKET_BSTAR(c0, c1);
             j <= k;
-            --i, --k) { SA[i] = SA[k]; }
+            --i, --k) {
+          SA[i] = SA[k];
+          if(LCP != nullptr) { LCP[i] = LCP[k]; }
+        }
       }
       SUFS_BUCKET_BSTAR(c0, c0 + 1) = i - SUFS_BUCKET_B(c0, c0) + 1; /* start point */
       SUFS_BUCKET_B(c0, c0) = i; /* end point */
@@ -187,16 +557,312 @@ template <typename CharT = unsigned char, typename ResultT = int32_t> static Res
   return m;
 }
 
-/* Constructs the suffix array by using the sorted order of type B* suffixes. */
-template <typename CharT = unsigned char, typename ResultT = int32_t> static void construct_SA(const CharT *T, ResultT *SA, ResultT *bucket_A, ResultT *bucket_B, ResultT n, ResultT m) noexcept {
+/* Cached state of one slot of the suffix array during parallel induction. */
+template <typename ResultT> struct induce_entry {
+  ResultT value;   /* final content of the slot */
+  ResultT induced; /* suffix induced from the slot */
+  ResultT dest;    /* slot the induced suffix is written to */
+  int32_t c0;      /* first character of the induced suffix, -1 if none, -2 at the primary index */
+};
+
+/* Reads the slot value v in the right-to-left (type B) scan. */
+template <bool BWT, typename CharT, typename ResultT> static inline void induce_typeB_step(const CharT *T, ResultT n, ResultT v, induce_entry<ResultT> & e) noexcept {
+  ResultT s;
+  int32_t c0;
+
+  if((0 < v) && (v < n)) {
+    c0 = T[s = v - 1];
+    e.value = BWT ? ~(static_cast<ResultT>(c0)) : ~v;
+    if((0 < s) && (T[s - 1] > c0)) { s = ~s; }
+    e.induced = s, e.c0 = c0;
+  } else {
+    e.value = (BWT && (v == 0)) ? 0 : ~v;
+    e.c0 = -1;
+  }
+}
+
+/* Reads the slot value v in the left-to-right (type A) scan. */
+template <bool BWT, typename CharT, typename ResultT> static inline void induce_typeA_step(const CharT *T, ResultT n, ResultT v, induce_entry<ResultT> & e) noexcept {
+  ResultT s;
+  int32_t c0;
+
+  if((0 < v) && (v < n)) {
+    c0 = T[s = v - 1];
+    if constexpr (BWT) {
+      e.value = c0;
+      if((0 < s) && (T[s - 1] < c0)) { s = ~(static_cast<ResultT>(T[s - 1])); }
+    } else {
+      e.value = v;
+      if((s == 0) || (T[s - 1] < c0)) { s = ~s; }
+    }
+    e.induced = s, e.c0 = c0;
+  } else if(BWT && (v == 0)) {
+    e.value = 0, e.c0 = -2;
+  } else {
+    e.value = ~v, e.c0 = -1;
+  }
+}
+
+/* Parallel version of the type B induction of construct_SA and construct_BWT.
+   Each bucket is scanned in blocks: all threads read their share of the block
+   and the text characters it refers to, thread 0 assigns the destinations
+   (re-reading the slots that were induced into the block itself), and all
+   threads write the block and the induced suffixes back. */
+template <bool BWT, typename CharT, typename ResultT> static void induce_typeB_parallel(const CharT *T, ResultT *SA, ResultT *bucket_A, ResultT *bucket_B, ResultT n, unsigned threads, int32_t sigma) {
+  const ResultT blocksize = static_cast<ResultT>(threads) * INDUCE_BLOCKSIZE;
+  std::vector<induce_entry<ResultT>> cache(blocksize);
+  std::barrier sync(threads);
+
+  parallel_run(threads, [&](unsigned tid) {
+    ResultT first, b, e, p, q, r, d;
+    int32_t c0, c1;
+
+    for(c1 = sigma - 2; 0 <= c1; --c1) {
+      first = SUFS_BUCKET_BSTAR(c1, c1 + 1);
+      for(e = bucket_A[c1 + 1]; first < e; e = b) {
+        b = std::max<ResultT>(first, e - blocksize);
+        q = b + (e - b) * tid / threads, r = b + (e - b) * (tid + 1) / threads;
+
+        for(p = q; p < r; ++p) { induce_typeB_step<BWT>(T, n, SA[p], cache[p - b]); }
+        sync.arrive_and_wait();
+
+        if(tid == 0) {
+          for(p = e - 1; b <= p; --p) {
+            induce_entry<ResultT> & entry = cache[p - b];
+            if(0 <= (c0 = entry.c0)) {
+              entry.dest = d = SUFS_BUCKET_B(c0, c1)--;
+              assert(d < p);
+              if(b <= d) { induce_typeB_step<BWT>(T, n, entry.induced, cache[d - b]); }
+            }
+          }
+        }
+        sync.arrive_and_wait();
+
+        for(p = q; p < r; ++p) {
+          const induce_entry<ResultT> & entry = cache[p - b];
+          SA[p] = entry.value;
+          if((0 <= entry.c0) && (entry.dest < b)) { SA[entry.dest] = entry.induced; }
+        }
+        sync.arrive_and_wait();
+      }
+    }
+  });
+}
+
+/* Parallel version of the type A induction of construct_SA and construct_BWT,
+   scanning the whole suffix array left to right in the same three steps.
+   Returns the primary index for BWT. */
+template <bool BWT, typename CharT, typename ResultT> static ResultT induce_typeA_parallel(const CharT *T, ResultT *SA, ResultT *bucket_A, ResultT n, unsigned threads) {
+  const ResultT blocksize = static_cast<ResultT>(threads) * INDUCE_BLOCKSIZE;
+  std::vector<induce_entry<ResultT>> cache(blocksize);
+  std::barrier sync(threads);
+  ResultT orig = 0;
+  int32_t c2;
+
+  c2 = T[n - 1];
+  if constexpr (BWT) {
+    SA[bucket_A[c2]++] = (T[n - 2] < c2) ? ~(static_cast<ResultT>(T[n - 2])) : (n - 1);
+  } else {
+    SA[bucket_A[c2]++] = (T[n - 2] < c2) ? ~(n - 1) : (n - 1);
+  }
+
+  parallel_run(threads, [&](unsigned tid) {
+    ResultT b, e, p, q, r, d;
+    int32_t c0;
+
+    for(b = 0; b < n; b = e) {
+      e = std::min<ResultT>(n, b + blocksize);
+      q = b + (e - b) * tid / threads, r = b + (e - b) * (tid + 1) / threads;
+
+      for(p = q; p < r; ++p) { induce_typeA_step<BWT>(T, n, SA[p], cache[p - b]); }
+      sync.arrive_and_wait();
+
+      if(tid == 0) {
+        for(p = b; p < e; ++p) {
+          induce_entry<ResultT> & entry = cache[p - b];
+          if(0 <= (c0 = entry.c0)) {
+            entry.dest = d = bucket_A[c0]++;
+            assert(p < d);
+            if(d < e) { induce_typeA_step<BWT>(T, n, entry.induced, cache[d - b]); }
+          } else if(c0 == -2) {
+            orig = p;
+          }
+        }
+      }
+      sync.arrive_and_wait();
+
+      for(p = q; p < r; ++p) {
+        const induce_entry<ResultT> & entry = cache[p - b];
+        SA[p] = entry.value;
+        if((0 <= entry.c0) && (e <= entry.dest)) { SA[entry.dest] = entry.induced; }
+      }
+      sync.arrive_and_wait();
+    }
+  });
+
+  return orig;
+}
+
+/* Minimum of the LCP values scanned since the last reset of each character,
+   for the LCP induction. Up to 16 characters, the minima are all updated on
+   each step. Otherwise the values are kept in blocks of 64 and the minima of
+   the characters are brought up to date once per block only, so that a step
+   costs O(1 + sigma / 64) whatever the alphabet. */
+template <typename ResultT> struct induce_minima {
+  std::vector<ResultT> mins, last;
+  ResultT vals[64];
+  ResultT t, bs, pm, inf;
+  bool direct;
+
+  induce_minima(int32_t sigma, ResultT n): mins(sigma, n), last(sigma, -1), t(0), bs(0), pm(n), inf(n), direct(sigma <= 16) { }
+
+  void push(ResultT h) noexcept {
+    if(direct) {
+      for(ResultT & x: mins) { x = std::min(x, h); }
+      return;
+    }
+    vals[t++ - bs] = h, pm = std::min(pm, h);
+    if((t - bs) == 64) {
+      /* Suffix minima of the block, then the minima of the characters. */
+      for(int k = 62; 0 <= k; --k) { vals[k] = std::min(vals[k], vals[k + 1]); }
+      for(std::size_t c = 0; c < mins.size(); ++c) {
+        if(last[c] < bs) { mins[c] = std::min(mins[c], vals[0]); }
+        else { mins[c] = ((last[c] - bs) < 64) ? vals[last[c] - bs] : inf; }
+      }
+      bs = t, pm = inf;
+    }
+  }
+  ResultT get(int32_t c) const noexcept {
+    ResultT h, k;
+    if(direct) { return mins[c]; }
+    if(last[c] < bs) { return std::min(mins[c], pm); }
+    for(h = inf, k = last[c] - bs; k < (t - bs); ++k) { h = std::min(h, vals[k]); }
+    return h;
+  }
+  void reset(int32_t c) noexcept {
+    if(direct) { mins[c] = inf; }
+    else { last[c] = t; }
+  }
+};
+
+/* Sequential construct_SA which also induces LCP[i], the LCP of SA[i - 1]
+   and SA[i], from the LCP of the type B* suffixes left by sort_typeBstar
+   (Fischer's inducing of the LCP array). Two suffixes induced one after the
+   other into the same bucket share one character more than the minimum LCP
+   scanned between the suffixes they were induced from (induce_minima). The
+   first suffix of a bucket or of a two-character sub-bucket shares 0 or 1
+   character with the preceding one, except at the boundaries between the
+   type A and type B suffixes of a bucket and between the type B* and the
+   other type B suffixes of a sub-bucket, which are compared directly. Those
+   comparisons stop within a run of equal characters following distinct
+   positions, so they take O(n) in total. */
+template <typename CharT, typename ResultT> static void construct_SA_lcp(const CharT *T, ResultT *SA, ResultT *LCP, ResultT *bucket_A, ResultT *bucket_B, ResultT n, ResultT m, int32_t sigma) {
+  std::vector<ResultT> Astart(sigma + 1), Bstart(sigma), last(sigma, -1);
+  ResultT i, j, k, s, e;
+  int32_t c0, c1, c2;
+
+  auto extend = [&](ResultT a, ResultT b, ResultT h) {
+    if(a < 0) { a = ~a; }
+    if(b < 0) { b = ~b; }
+    for(; (a + h < n) && (b + h < n) && (T[a + h] == T[b + h]); ++h) { }
+    return h;
+  };
+
+  /* Bucket bounds; the type B suffixes of bucket c start at Bstart[c]. */
+  for(c0 = 0; c0 < sigma; ++c0) { Astart[c0] = bucket_A[c0]; }
+  Astart[sigma] = n;
+  for(c0 = 0; c0 < sigma; ++c0) {
+    Bstart[c0] = ((0 < m) && (c0 < (sigma - 1))) ? SUFS_BUCKET_BSTAR(c0, c0 + 1) : Astart[c0 + 1];
+  }
+
+  if(0 < m) {
+    /* The first suffix of each sub-bucket shares its first character with the
+       preceding suffix; the first ones of the buckets are set below. */
+    for(c0 = 0; c0 < (sigma - 1); ++c0) {
+      for(c1 = c0, s = Bstart[c0]; c1 < sigma; ++c1) {
+        if(s <= (e = SUFS_BUCKET_B(c0, c1))) { LCP[s] = 1, s = e + 1; }
+      }
+    }
+
+    /* Type B suffixes, scanning each bucket from right to left. */
+    for(c1 = sigma - 2; 0 <= c1; --c1) {
+      induce_minima<ResultT> minima(c1 + 1, n);
+      for(j = Astart[c1 + 1] - 1; Bstart[c1] <= j; --j) {
+        if(j < (Astart[c1 + 1] - 1)) { minima.push(LCP[j + 1]); }
+        if(0 < (s = SA[j])) {
+          SA[j] = ~s;
+          c0 = T[--s];
+          if((0 < s) && (T[s - 1] > c0)) { s = ~s; }
+          k = SUFS_BUCKET_B(c0, c1)--;
+          SA[k] = s;
+          if(0 <= last[c0]) { LCP[k + 1] = minima.get(c0) + 1; }
+          last[c0] = j, minima.reset(c0);
+        } else {
+          SA[j] = ~s;
+        }
+      }
+
+      /* The last suffix induced into (c0, c1) follows its type B* suffixes. */
+      for(c0 = 0; c0 <= c1; ++c0) {
+        if(last[c0] < 0) { continue; }
+        last[c0] = -1;
+        k = SUFS_BUCKET_B(c0, c1);
+        if((c0 < c1) && (SUFS_BUCKET_B(c0, c1 - 1) < k)) { LCP[k + 1] = extend(SA[k], SA[k + 1], 2); }
+      }
+    }
+  }
+
+  /* Type A suffixes, scanning the suffix array from left to right;
+     last[c] == -2 stands for the last suffix T[n-1], which shares one
+     character with the next one. */
+  k = bucket_A[c2 = T[n - 1]]++;
+  SA[k] = (T[n - 2] < c2) ? static_cast<ResultT>(~(n - 1)) : static_cast<ResultT>(n - 1);
+  LCP[k] = 0, last[c2] = -2;
+  induce_minima<ResultT> minima(sigma, n);
+  for(i = 0, c1 = 0; i < n; ++i) {
+    for(; Astart[c1 + 1] <= i; ++c1) { }
+    if(i == Bstart[c1]) {
+      LCP[i] = (Astart[c1] < i) ? extend(SA[i - 1], SA[i], 1) : ResultT{0};
+    }
+    minima.push(LCP[i]);
+    if(0 < (s = SA[i])) {
+      c0 = T[--s];
+      if((s == 0) || (T[s - 1] < c0)) { s = ~s; }
+      k = bucket_A[c0]++;
+      SA[k] = s;
+      if(k == Astart[c0]) { LCP[k] = 0; }
+      else if(last[c0] == -2) { LCP[k] = 1; }
+      else { LCP[k] = minima.get(c0) + 1; }
+      last[c0] = i, minima.reset(c0);
+    } else {
+      SA[i] = ~s;
+    }
+  }
+}
+
+/* Constructs the suffix array by using the sorted order of type B* suffixes.
+   When LCP is not null, the LCP array is induced along (see construct_SA_lcp)
+   and LCP must hold the type B* LCP left by sort_typeBstar. */
+template <typename CharT = unsigned char, typename ResultT = int32_t> static void construct_SA(const CharT *T, ResultT *SA, ResultT *bucket_A, ResultT *bucket_B, ResultT n, ResultT m, unsigned threads = 1, int32_t sigma = static_cast<int32_t>(alphabet_size<CharT>), ResultT *LCP = nullptr) {
   ResultT *i, *j, *k;
   ResultT s;
   int32_t c0, c1, c2;
 
+  if(LCP != nullptr) {
+    construct_SA_lcp(T, SA, LCP, bucket_A, bucket_B, n, m, sigma);
+    return;
+  }
+
+  if((1 < threads) && ((static_cast<ResultT>(threads) * INDUCE_BLOCKSIZE) < n)) {
+    if(0 < m) { induce_typeB_parallel<false>(T, SA, bucket_A, bucket_B, n, threads, sigma); }
+    induce_typeA_parallel<false>(T, SA, bucket_A, n, threads);
+    return;
+  }
+
   if(0 < m) {
     /* Construct the sorted order of type B suffixes by using
        the sorted order of type B* suffixes. */
-    for(c1 = alphabet_size<CharT> - 2; 0 <= c1; --c1) {
+    for(c1 = sigma - 2; 0 <= c1; --c1) {
       /* Scan the suffix array from right to left. */
       // hana: k = j is difference against upstream, so it won't dereference nullptr
       for(i = SA + SUFS_BUCKET_BSTAR(c1, c1 + 1),
@@ -248,16 +914,29 @@ template <typename CharT = unsigned char, typename ResultT = int32_t> static voi
 }
 
 /* Constructs the burrows-wheeler transformed string directly
-   by using the sorted order of type B* suffixes. */
-template <typename CharT = unsigned char, typename ResultT = int32_t> static ResultT construct_BWT(const CharT *T, ResultT *SA, ResultT *bucket_A, ResultT *bucket_B, ResultT n, ResultT m) noexcept {
+   by using the sorted order of type B* suffixes. When indexes is not null,
+   indexes[s / interval] also receives the row of each suffix s multiple of
+   interval, counted like the primary index (see divbwt); the rows are taken
+   as the suffixes are scanned or induced, which the parallel induction does
+   not track, so it runs sequentially then. */
+template <typename CharT = unsigned char, typename ResultT = int32_t> static ResultT construct_BWT(const CharT *T, ResultT *SA, ResultT *bucket_A, ResultT *bucket_B, ResultT n, ResultT m, unsigned threads = 1, int32_t sigma = static_cast<int32_t>(alphabet_size<CharT>), ResultT *indexes = nullptr, ResultT interval = 0) {
   ResultT *i, *j, *k, *orig;
-  ResultT s;
+  ResultT s, t;
   int32_t c0, c1, c2;
 
+  auto sample = [&](ResultT suf, const ResultT *row) {
+    if((indexes != nullptr) && ((suf % interval) == 0)) { indexes[suf / interval] = static_cast<ResultT>(row - SA + 1); }
+  };
+
+  if((indexes == nullptr) && (1 < threads) && ((static_cast<ResultT>(threads) * INDUCE_BLOCKSIZE) < n)) {
+    if(0 < m) { induce_typeB_parallel<true>(T, SA, bucket_A, bucket_B, n, threads, sigma); }
+    return induce_typeA_parallel<true>(T, SA, bucket_A, n, threads);
+  }
+
   if(0 < m) {
     /* Construct the sorted order of type B suffixes by using
        the sorted order of type B* suffixes. */
-    for(c1 = alphabet_size<CharT> - 2; 0 <= c1; --c1) {
+    for(c1 = sigma - 2; 0 <= c1; --c1) {
       /* Scan the suffix array from right to left. */
       for(i = SA + SUFS_BUCKET_BSTAR(c1, c1 + 1),
           j = SA + bucket_A[c1 + 1] - 1, k = nullptr, c2 = -1;
@@ -267,6 +946,7 @@ template <typename CharT = unsigned char, typename ResultT = int32_t> static Res
           assert(T[s] == c1);
           assert(((s + 1) < n) && (T[s] <= T[s + 1]));
           assert(T[s - 1] <= T[s]);
+          sample(s, j);
           c0 = T[--s];
           *j = ~(static_cast<ResultT>(c0));
           if((0 < s) && (T[s - 1] > c0)) { s = ~s; }
@@ -288,12 +968,14 @@ template <typename CharT = unsigned char, typename ResultT = int32_t> static Res
   /* Construct the BWTed string by using
      the sorted order of type B suffixes. */
   k = SA + bucket_A[c2 = T[n - 1]];
+  if(T[n - 2] < c2) { sample(n - 1, k); }
   *k++ = (T[n - 2] < c2) ? ~(static_cast<ResultT>(T[n - 2])) : (n - 1);
   /* Scan the suffix array from left to right. */
   for(i = SA, j = SA + n, orig = SA; i < j; ++i) {
     if(0 < (s = *i)) {
       assert(T[s - 1] >= T[s]);
-      c0 = T[--s];
+      sample(s, i);
+      c0 = T[t = --s];
       *i = c0;
       if((0 < s) && (T[s - 1] < c0)) { s = ~(static_cast<ResultT>(T[s - 1])); }
       if(c0 != c2) {
@@ -301,6 +983,7 @@ template <typename CharT = unsigned char, typename ResultT = int32_t> static Res
         k = SA + bucket_A[c2 = c0];
       }
       assert(i < k);
+      if(s < 0) { sample(t, k); } /* written as a character, never scanned */
       *k++ = s;
     } else if(s != 0) {
       *i = ~s;
@@ -308,10 +991,81 @@ template <typename CharT = unsigned char, typename ResultT = int32_t> static Res
       orig = i;
     }
   }
+  sample(0, orig);
 
   return orig - SA;
 }
 
+/* Alphabet compaction. Maps the symbols occurring in T onto the dense range
+   [0, sigma) keeping their order, so that the bucket tables and the bucket
+   loops of the core scale with sigma^2 instead of alphabet_size^2. rank
+   receives the dense code of each symbol and symbols the inverse mapping.
+   Returns sigma. */
+template <typename CharT, typename ResultT> static int32_t compact_alphabet(const CharT *T, ResultT n, std::array<int32_t, alphabet_size<CharT>> & rank, std::array<CharT, alphabet_size<CharT>> & symbols) noexcept {
+  int32_t c, sigma;
+
+  rank.fill(0);
+  for(ResultT i = 0; i < n; ++i) { rank[T[i]] = 1; }
+  for(c = 0, sigma = 0; c < static_cast<int32_t>(alphabet_size<CharT>); ++c) {
+    if(rank[c] != 0) { symbols[sigma] = static_cast<CharT>(c); rank[c] = sigma++; }
+  }
+  return sigma;
+}
+
+/* Sorts the suffixes of R[0..n-1], whose symbols are in [0, sigma), and
+   induces the LCP array along when LCP is not null. */
+template <typename ResultT> static void suffix_sort_compact(const unsigned char *R, ResultT *SA, ResultT n, unsigned threads, int32_t sigma, ResultT *LCP = nullptr, ResultT *work = nullptr, ResultT worksize = 0) {
+  std::vector<ResultT> bucket_A(static_cast<std::size_t>(sigma)), bucket_B(static_cast<std::size_t>(sigma) * sigma);
+
+  ResultT m = sort_typeBstar<unsigned char, ResultT>(R, SA, bucket_A.data(), bucket_B.data(), n, threads, sigma, LCP, work, worksize);
+  construct_SA<unsigned char, ResultT>(R, SA, bucket_A.data(), bucket_B.data(), n, m, threads, sigma, LCP);
+}
+
+/* Large-alphabet engine. The symbols of T are remapped onto the dense range
+   [0, sigma) keeping their order; when sigma fits a byte the remapped text is
+   sorted by the byte engine with a runtime sigma, otherwise by induced sorting (sais_main). Needs
+   n extra symbols plus a table of O(sigma) entries, or of O(n) when the
+   symbol values are scattered. */
+template <typename CharT, typename ResultT> static void suffix_sort_large(const CharT *T, ResultT *SA, ResultT n, unsigned threads, ResultT *work = nullptr, ResultT worksize = 0) {
+  using UCharT = std::make_unsigned_t<CharT>;
+  const auto [lo, hi] = std::minmax_element(T, T + n);
+  const uint64_t range = static_cast<UCharT>(static_cast<UCharT>(*hi) - static_cast<UCharT>(*lo));
+  std::vector<ResultT> rank;
+  std::vector<CharT> symbols;
+  ResultT i, sigma;
+
+  if(range < static_cast<uint64_t>(n) + 65536) {
+    /* Dense enough for a direct rank table. */
+    rank.assign(range + 1, 0);
+    for(i = 0; i < n; ++i) { rank[static_cast<UCharT>(static_cast<UCharT>(T[i]) - static_cast<UCharT>(*lo))] = 1; }
+    sigma = 0;
+    for(ResultT & r: rank) { ResultT used = r; r = sigma; sigma += used; }
+  } else {
+    symbols.assign(T, T + n);
+    std::sort(symbols.begin(), symbols.end());
+    symbols.erase(std::unique(symbols.begin(), symbols.end()), symbols.end());
+    sigma = static_cast<ResultT>(symbols.size());
+  }
+  auto remap = [&](CharT c) -> ResultT {
+    if(!rank.empty()) { return rank[static_cast<UCharT>(static_cast<UCharT>(c) - static_cast<UCharT>(*lo))]; }
+    return static_cast<ResultT>(std::lower_bound(symbols.begin(), symbols.end(), c) - symbols.begin());
+  };
+
+  if(sigma <= static_cast<ResultT>(alphabet_size<unsigned char>)) {
+    std::vector<unsigned char> R(n);
+    for(i = 0; i < n; ++i) { R[i] = static_cast<unsigned char>(remap(T[i])); }
+    rank = std::vector<ResultT>(), symbols = std::vector<CharT>();
+
+    suffix_sort_compact<ResultT>(R.data(), SA, n, threads, static_cast<int32_t>(sigma), nullptr, work, worksize);
+  } else {
+    std::vector<UCharT> R(n);
+    for(i = 0; i < n; ++i) { R[i] = static_cast<UCharT>(remap(T[i])); }
+    rank = std::vector<ResultT>(), symbols = std::vector<CharT>();
+
+    sais_main<UCharT, ResultT>(R.data(), SA, n, sigma);
+  }
+}
+
 } // namespace divss
 
 /*---------------------------------------------------------------------------*/
@@ -320,7 +1074,18 @@ template <typename CharT = unsigned char, typename ResultT = int32_t> static Res
 
 namespace divss {
 
-template <typename CharT = unsigned char, typename ResultT = int32_t> void suffix_sort(const CharT *T, ResultT *SA, no_deduce<ResultT> n) noexcept {
+/* Constructs the suffix array of T[0..n-1] into SA[0..n-1]. With threads > 1
+   the type B* substrings are sorted and the remaining suffixes are induced
+   by that many threads. Texts of at most COMPACT_N_MAX symbols using at
+   most COMPACT_SIGMA_MAX distinct ones are sorted on a compacted copy with
+   smaller bucket tables; longer texts are sorted in place.
+   work[0..worksize-1] is an optional workspace used instead of the part of
+   SA left free by the type B* suffixes when it is larger: it is the buffer
+   of the substring merges and of the parallel rank snapshot of trsort. The
+   sort needs no more than n / 2 entries of it. Throws std::bad_alloc if its
+   temporary storage cannot be allocated and std::system_error if a thread
+   cannot be started. */
+template <typename CharT = unsigned char, typename ResultT = int32_t> void suffix_sort(const CharT *T, ResultT *SA, no_deduce<ResultT> n, unsigned threads = 1, no_deduce<ResultT> *work = nullptr, no_deduce<ResultT> worksize = 0) {
   /* Check arguments. */
 	assert(T != nullptr);
 	assert(SA != nullptr);
@@ -330,48 +1095,227 @@ template <typename CharT = unsigned char, typename ResultT = int32_t> void suffi
   else if(n == 1) { SA[0] = 0; return; }
   else if(n == 2) { bool ordered = (T[0] < T[1]); SA[ordered ^ 1] = 0, SA[ordered] = 1; return; }
 
-  std::array<ResultT, bucket_A_size<CharT>> bucket_A{};
-  std::array<ResultT, bucket_B_size<CharT>> bucket_B{};
+  if constexpr(large_alphabet<CharT>) {
+    internal::suffix_sort_large<CharT, ResultT>(T, SA, n, threads, work, worksize);
+  } else {
+    std::array<int32_t, alphabet_size<CharT>> rank;
+    std::array<CharT, alphabet_size<CharT>> symbols;
+    int32_t sigma = (n <= COMPACT_N_MAX) ? internal::compact_alphabet(T, n, rank, symbols) : COMPACT_SIGMA_MAX + 1;
 
-  ResultT m = internal::sort_typeBstar(T, SA, bucket_A.data(), bucket_B.data(), n);
-  internal::construct_SA(T, SA, bucket_A.data(), bucket_B.data(), n, m);
+    if(sigma <= COMPACT_SIGMA_MAX) {
+      std::vector<unsigned char> R(n);
+      for(ResultT i = 0; i < n; ++i) { R[i] = static_cast<unsigned char>(rank[T[i]]); }
+      internal::suffix_sort_compact<ResultT>(R.data(), SA, n, threads, sigma, nullptr, work, worksize);
+      return;
+    }
+
+    std::array<ResultT, bucket_A_size<CharT>> bucket_A{};
+    std::array<ResultT, bucket_B_size<CharT>> bucket_B{};
+
+    ResultT m = internal::sort_typeBstar<CharT, ResultT>(T, SA, bucket_A.data(), bucket_B.data(), n, threads, static_cast<int32_t>(alphabet_size<CharT>), nullptr, work, worksize);
+    internal::construct_SA(T, SA, bucket_A.data(), bucket_B.data(), n, m, threads);
+  }
+}
+
+/* Constructs the suffix array of T[0..n-1] into SA[0..n-1] and its LCP
+   array into LCP[0..n-1] (LCP[i] is the LCP of SA[i - 1] and SA[i], LCP[0] is
+   0) in one construction: the LCP of the type B* suffixes is computed once
+   they are sorted and the others are induced along with the suffixes.
+   threads applies to the type B* sort; the induction is sequential. Symbol
+   types wider than a byte are sorted by suffix_sort and go through
+   lcp_array. Returns 0 on success, -1 for bad arguments and -2 if it runs
+   out of memory or cannot start its threads. */
+template <typename CharT = unsigned char, typename ResultT = int32_t> int32_t suffix_sort_with_lcp(const CharT *T, ResultT *SA, ResultT *LCP, no_deduce<ResultT> n, unsigned threads = 1) noexcept {
+  /* Check arguments. */
+  if((T == nullptr) || (SA == nullptr) || (LCP == nullptr) || (n < 0)) { return -1; }
+  else if(n == 0) { return 0; }
+  else if(n == 1) { SA[0] = 0, LCP[0] = 0; return 0; }
+  else if(n == 2) { bool ordered = (T[0] < T[1]); SA[ordered ^ 1] = 0, SA[ordered] = 1, LCP[0] = 0, LCP[1] = (T[0] == T[1]); return 0; }
+
+  try {
+    if constexpr(large_alphabet<CharT>) {
+      suffix_sort(T, SA, n, threads);
+      return lcp_array(T, SA, LCP, n, threads);
+    } else {
+      std::array<int32_t, alphabet_size<CharT>> rank;
+      std::array<CharT, alphabet_size<CharT>> symbols;
+      int32_t sigma = (n <= COMPACT_N_MAX) ? internal::compact_alphabet(T, n, rank, symbols) : COMPACT_SIGMA_MAX + 1;
+
+      if(sigma <= COMPACT_SIGMA_MAX) {
+        std::vector<unsigned char> R(n);
+        for(ResultT i = 0; i < n; ++i) { R[i] = static_cast<unsigned char>(rank[T[i]]); }
+        internal::suffix_sort_compact<ResultT>(R.data(), SA, n, threads, sigma, LCP);
+        return 0;
+      }
+
+      std::array<ResultT, bucket_A_size<CharT>> bucket_A{};
+      std::array<ResultT, bucket_B_size<CharT>> bucket_B{};
+
+      ResultT m = internal::sort_typeBstar(T, SA, bucket_A.data(), bucket_B.data(), n, threads, static_cast<int32_t>(alphabet_size<CharT>), LCP);
+      internal::construct_SA(T, SA, bucket_A.data(), bucket_B.data(), n, m, threads, static_cast<int32_t>(alphabet_size<CharT>), LCP);
+    }
+  } catch(const std::bad_alloc &) {
+    return -2;
+  } catch(const std::system_error &) {
+    return -2;
+  }
+  return 0;
 }
 
-template <typename ResultT = int32_t, typename CharT = unsigned char> auto suffix_array(std::span<const CharT> T) noexcept -> std::vector<ResultT> {
+/* Returns the suffix array of T, sorted as by suffix_sort, and throws as
+   suffix_sort does. */
+template <typename ResultT = int32_t, typename CharT = unsigned char> auto suffix_array(std::span<const CharT> T, unsigned threads = 1) -> std::vector<ResultT> {
 	auto result = std::vector<ResultT>(T.size());
 	
-	suffix_sort(T.data(), result.data(), T.size());
+	suffix_sort(T.data(), result.data(), T.size(), threads);
 	
 	return result;
 }
 
-template <typename CharT = unsigned char, typename ResultT = int32_t> ResultT divbwt(const CharT *T, CharT *U, ResultT *A, no_deduce<ResultT> n) noexcept {
+/* Constructs the generalized suffix array of the documents docs into
+   SA[0..n-1], n being their total length. Each document is followed by its
+   own virtual sentinel, smaller than every symbol and ordered by document,
+   so suffixes never run into the next document and no separator symbol is
+   needed. SA receives offsets into the concatenation of the documents and,
+   when DA is not null, DA[i] the index of the document holding SA[i].
+   Returns 0 on success, -1 for bad arguments and -2 if it runs out of
+   memory. */
+template <typename CharT = unsigned char, typename ResultT = int32_t> int32_t generalized_suffix_array(std::span<const std::span<const CharT>> docs, ResultT *SA, ResultT *DA = nullptr) noexcept {
+  using UCharT = std::make_unsigned_t<CharT>;
+  std::vector<ResultT> offsets;
+  ResultT i, n = 0, k;
+
+  try {
+    /* Check arguments. */
+    offsets.reserve(docs.size() + 1);
+    for(const auto & doc: docs) {
+      if(static_cast<uint64_t>(std::numeric_limits<ResultT>::max() - n) < doc.size()) { return -1; }
+      offsets.push_back(n);
+      n += static_cast<ResultT>(doc.size());
+    }
+    offsets.push_back(n);
+    if(n == 0) { return 0; }
+    if(SA == nullptr) { return -1; }
+
+    /* Concatenate the documents and mark their last positions. */
+    std::vector<UCharT> R(n);
+    std::vector<bool> ends(n);
+    for(std::size_t d = 0; d < docs.size(); ++d) {
+      std::copy(docs[d].begin(), docs[d].end(), R.begin() + offsets[d]);
+      if(offsets[d] < offsets[d + 1]) { ends[offsets[d + 1] - 1] = true; }
+    }
+    if constexpr(large_alphabet<CharT>) {
+      std::vector<UCharT> symbols(R);
+      std::sort(symbols.begin(), symbols.end());
+      symbols.erase(std::unique(symbols.begin(), symbols.end()), symbols.end());
+      for(UCharT & c: R) { c = static_cast<UCharT>(std::lower_bound(symbols.begin(), symbols.end(), c) - symbols.begin()); }
+      k = static_cast<ResultT>(symbols.size());
+    } else {
+      k = static_cast<ResultT>(alphabet_size<CharT>);
+    }
+
+    internal::sais_main<UCharT, ResultT>(R.data(), SA, n, k, &ends);
+
+    /* Document array: the document of p is found by counting the document
+       ends before p, 64 positions per word. */
+    if(DA != nullptr) {
+      std::vector<ResultT> docid, rank((n >> 6) + 1);
+      std::vector<uint64_t> words((n >> 6) + 1);
+      for(std::size_t d = 0; d < docs.size(); ++d) {
+        if(offsets[d] < offsets[d + 1]) { docid.push_back(static_cast<ResultT>(d)); }
+      }
+      for(i = 0; i < n; ++i) {
+        if(ends[i]) { words[i >> 6] |= uint64_t{1} << (i & 63); }
+      }
+      for(std::size_t w = 1; w < words.size(); ++w) { rank[w] = rank[w - 1] + std::popcount(words[w - 1]); }
+      for(i = 0; i < n; ++i) {
+        const ResultT p = SA[i];
+        DA[i] = docid[rank[p >> 6] + std::popcount(words[p >> 6] & ((uint64_t{1} << (p & 63)) - 1))];
+      }
+    }
+  } catch(const std::bad_alloc &) {
+    return -2;
+  }
+  return 0;
+}
+
+/* Constructs the Burrows-Wheeler transform of T[0..n-1] into U[0..n-1], A
+   being an optional workspace of n + 1 entries, and returns the primary
+   index, -1 for bad arguments or -2 if it runs out of memory or cannot
+   start its threads. When indexes is not null, it receives the
+   primary indexes of the (n - 1) / interval + 1 positions multiple of
+   interval: indexes[k] is the row of the suffix k * interval, counted like
+   the primary index, so indexes[0] is the primary index itself and the
+   inverse transform can start from any of them (see inverse_bw_transform).
+   work[0..worksize-1] is an optional workspace as for suffix_sort. */
+template <typename CharT = unsigned char, typename ResultT = int32_t> ResultT divbwt(const CharT *T, CharT *U, ResultT *A, no_deduce<ResultT> n, unsigned threads = 1, ResultT *indexes = nullptr, no_deduce<ResultT> interval = 0, no_deduce<ResultT> *work = nullptr, no_deduce<ResultT> worksize = 0) noexcept {
   ResultT *B;
 
   /* Check arguments. */
-  if((T == nullptr) || (U == nullptr) || (n < 0)) { return -1; }
-  else if(n <= 1) { if(n == 1) { U[0] = T[0]; } return n; }
-
-  if((B = A) == nullptr) { 
-    B = new ResultT[n + 1]{};
+  if((T == nullptr) || (U == nullptr) || (n < 0) || ((indexes != nullptr) && (interval < 1))) { return -1; }
+  else if(n <= 1) {
+    if(n == 1) { U[0] = T[0]; if(indexes != nullptr) { indexes[0] = 1; } }
+    return n;
   }
-	
-	std::array<ResultT, bucket_A_size<CharT>> bucket_A{};
-	std::array<ResultT, bucket_B_size<CharT>> bucket_B{};
 
-  /* Burrows-Wheeler Transform. */
-  ResultT m = internal::sort_typeBstar(T, B, bucket_A.data(), bucket_B.data(), n);
-  ResultT pidx = internal::construct_BWT(T, B, bucket_A.data(), bucket_B.data(), n, m);
+  std::unique_ptr<ResultT[]> owned;
+  ResultT i = 0, pidx;
+  try {
+    if((B = A) == nullptr) { owned.reset(new ResultT[n + 1]{}), B = owned.get(); }
+
+    if constexpr(large_alphabet<CharT>) {
+      /* Derive the transform from the suffix array. */
+      internal::suffix_sort_large<CharT, ResultT>(T, B, n, threads, work, worksize);
+      U[0] = T[n - 1];
+      for(; B[i] != 0; ++i) { U[i + 1] = T[B[i] - 1]; }
+      pidx = i + 1;
+      for(++i; i < n; ++i) { U[i] = T[B[i] - 1]; }
+      if(indexes != nullptr) {
+        for(i = 0; i < n; ++i) {
+          if((B[i] % interval) == 0) { indexes[B[i] / interval] = i + 1; }
+        }
+      }
+    } else {
+      std::array<int32_t, alphabet_size<CharT>> rank;
+      std::array<CharT, alphabet_size<CharT>> symbols;
+      int32_t sigma = (n <= COMPACT_N_MAX) ? internal::compact_alphabet(T, n, rank, symbols) : COMPACT_SIGMA_MAX + 1;
+
+      if(sigma <= COMPACT_SIGMA_MAX) {
+        std::vector<unsigned char> R(n);
+        std::vector<ResultT> bucket_A(static_cast<std::size_t>(sigma)), bucket_B(static_cast<std::size_t>(sigma) * sigma);
+        for(i = 0; i < n; ++i) { R[i] = static_cast<unsigned char>(rank[T[i]]); }
 
-  /* Copy to output string. */
-  U[0] = T[n - 1];
-  ResultT i = 0;
-  for(; i < pidx; ++i) { U[i + 1] = static_cast<CharT>(B[i]); }
-  for(i += 1; i < n; ++i) { U[i] = static_cast<CharT>(B[i]); }
-  pidx += 1;
+        /* Burrows-Wheeler Transform of the compacted text. */
+        ResultT m = internal::sort_typeBstar<unsigned char, ResultT>(R.data(), B, bucket_A.data(), bucket_B.data(), n, threads, sigma, nullptr, work, worksize);
+        pidx = internal::construct_BWT<unsigned char, ResultT>(R.data(), B, bucket_A.data(), bucket_B.data(), n, m, threads, sigma, indexes, interval);
 
-  if(A == nullptr) { delete[] B; }
+        /* Copy to output string, restoring the symbols. */
+        U[0] = T[n - 1];
+        for(i = 0; i < pidx; ++i) { U[i + 1] = symbols[B[i]]; }
+        for(i += 1; i < n; ++i) { U[i] = symbols[B[i]]; }
+        pidx += 1;
 
+        return pidx;
+      }
+
+      std::array<ResultT, bucket_A_size<CharT>> bucket_A{};
+      std::array<ResultT, bucket_B_size<CharT>> bucket_B{};
+
+      /* Burrows-Wheeler Transform. */
+      ResultT m = internal::sort_typeBstar<CharT, ResultT>(T, B, bucket_A.data(), bucket_B.data(), n, threads, static_cast<int32_t>(alphabet_size<CharT>), nullptr, work, worksize);
+      pidx = internal::construct_BWT(T, B, bucket_A.data(), bucket_B.data(), n, m, threads, static_cast<int32_t>(alphabet_size<CharT>), indexes, interval);
+
+      /* Copy to output string. */
+      U[0] = T[n - 1];
+      for(; i < pidx; ++i) { U[i + 1] = static_cast<CharT>(B[i]); }
+      for(i += 1; i < n; ++i) { U[i] = static_cast<CharT>(B[i]); }
+      pidx += 1;
+    }
+  } catch(const std::bad_alloc &) {
+    return -2;
+  } catch(const std::system_error &) {
+    return -2;
+  }
   return pidx;
 }
 
@@ -380,3 +1324,5 @@ const char * divsufsort_version(void) {
 }
 
 } // namespace divss 
+
+#endif
@@ -0,0 +1,365 @@
+#ifndef LIBDIVSUFSORT_EXTERNAL_HPP
+#define LIBDIVSUFSORT_EXTERNAL_HPP
+
+#include "divsufsort.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <future>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace divss::internal {
+
+/*- Private Functions -*/
+
+#define EXT_CHUNKSIZE (1 << 20) /* bytes per I/O chunk at most */
+#define EXT_STREAMS (3) /* streams open at once, each with two chunks */
+#define EXT_OCC_INTERVAL (128)
+
+/* Reads all of buf from fd at offset, retrying short reads. */
+static inline bool ext_pread(int fd, void *buf, std::size_t size, int64_t offset) noexcept {
+  for(char *p = static_cast<char *>(buf); 0 < size;) {
+    ssize_t r = ::pread(fd, p, size, static_cast<off_t>(offset));
+    if(r <= 0) { return false; }
+    p += r, size -= static_cast<std::size_t>(r), offset += r;
+  }
+  return true;
+}
+
+static inline bool ext_pwrite(int fd, const void *buf, std::size_t size, int64_t offset) noexcept {
+  for(const char *p = static_cast<const char *>(buf); 0 < size;) {
+    ssize_t r = ::pwrite(fd, p, size, static_cast<off_t>(offset));
+    if(r <= 0) { return false; }
+    p += r, size -= static_cast<std::size_t>(r), offset += r;
+  }
+  return true;
+}
+
+/* Sequential reader of the elements [first, last) of a file, forward or
+   backward, in chunks of chunk bytes. The next chunk is read on another
+   thread while the current one is consumed. */
+template <typename E> class ext_input {
+  int fd_;
+  int64_t chunk_, first_, last_, next_;
+  bool backward_, failed_ = false;
+  std::vector<E> cur_, spare_;
+  std::size_t idx_ = 0, count_ = 0;
+  std::future<std::size_t> pending_;
+
+  void issue() {
+    int64_t size = std::min<int64_t>(chunk_, backward_ ? (next_ - first_) : (last_ - next_));
+    int64_t from = backward_ ? (next_ - size) : next_;
+    if(size <= 0) { return; }
+    next_ = backward_ ? from : (next_ + size);
+    pending_ = std::async(std::launch::async, [this, size, from]() -> std::size_t {
+      spare_.resize(static_cast<std::size_t>(size));
+      return ext_pread(fd_, spare_.data(), spare_.size() * sizeof(E), from * static_cast<int64_t>(sizeof(E))) ? spare_.size() : 0;
+    });
+  }
+
+public:
+  ext_input(int fd, int64_t first, int64_t last, bool backward, std::size_t chunk = EXT_CHUNKSIZE):
+    fd_(fd), chunk_(std::max<int64_t>(1, static_cast<int64_t>(chunk / sizeof(E)))), first_(first), last_(last), next_(backward ? last : first), backward_(backward) {
+    issue();
+  }
+  ~ext_input() { if(pending_.valid()) { pending_.wait(); } }
+
+  bool get(E & v) {
+    if(idx_ == count_) {
+      if(!pending_.valid()) { return false; }
+      count_ = pending_.get(), idx_ = 0;
+      if(count_ == 0) { failed_ = true; return false; }
+      std::swap(cur_, spare_);
+      issue();
+    }
+    v = backward_ ? cur_[count_ - 1 - idx_++] : cur_[idx_++];
+    return true;
+  }
+  bool failed() const noexcept { return failed_; }
+};
+
+/* Sequential writer of a file; full chunks of chunk bytes are written on
+   another thread. */
+template <typename E> class ext_output {
+  int fd_;
+  std::size_t chunk_;
+  int64_t offset_ = 0;
+  bool failed_ = false;
+  std::vector<E> cur_, spare_;
+  std::future<bool> pending_;
+
+  void issue() {
+    if(pending_.valid() && !pending_.get()) { failed_ = true; }
+    std::swap(cur_, spare_);
+    cur_.clear();
+    int64_t offset = offset_;
+    offset_ += static_cast<int64_t>(spare_.size() * sizeof(E));
+    pending_ = std::async(std::launch::async, [this, offset]() {
+      return ext_pwrite(fd_, spare_.data(), spare_.size() * sizeof(E), offset);
+    });
+  }
+
+public:
+  explicit ext_output(int fd, std::size_t chunk = EXT_CHUNKSIZE): fd_(fd), chunk_(std::max<std::size_t>(1, chunk / sizeof(E))) { cur_.reserve(chunk_), spare_.reserve(chunk_); }
+  ~ext_output() { if(pending_.valid()) { pending_.wait(); } }
+
+  void put(const E & v) {
+    cur_.push_back(v);
+    if(cur_.size() == chunk_) { issue(); }
+  }
+  /* Writes the pending elements; returns false if any write failed. */
+  bool close() {
+    if(!cur_.empty()) { issue(); }
+    if(pending_.valid() && !pending_.get()) { failed_ = true; }
+    return !failed_;
+  }
+};
+
+/* Bit streams over ext_input/ext_output, 64 bits per word. */
+class ext_bit_input {
+  ext_input<uint64_t> in_;
+  uint64_t word_ = 0;
+  int bit_ = 64;
+
+public:
+  ext_bit_input(int fd, int64_t bits, std::size_t chunk = EXT_CHUNKSIZE): in_(fd, 0, (bits + 63) / 64, false, chunk) { }
+  bool get() {
+    if(bit_ == 64) { in_.get(word_), bit_ = 0; }
+    return (word_ >> bit_++) & 1;
+  }
+  bool failed() const noexcept { return in_.failed(); }
+};
+
+class ext_bit_output {
+  ext_output<uint64_t> out_;
+  uint64_t word_ = 0;
+  int bit_ = 0;
+
+public:
+  explicit ext_bit_output(int fd, std::size_t chunk = EXT_CHUNKSIZE): out_(fd, chunk) { }
+  void put(bool b) {
+    word_ |= static_cast<uint64_t>(b) << bit_;
+    if(++bit_ == 64) { out_.put(word_), word_ = 0, bit_ = 0; }
+  }
+  bool close() {
+    if(bit_ != 0) { out_.put(word_); }
+    return out_.close();
+  }
+};
+
+/* Sorts the suffixes T[b..] starting in the block [b, e) of length l, given
+   W = T[b..e + l) and the ranks of the suffixes starting in [e, e + l) among
+   themselves (rank_next). Two suffixes of the block are ordered by their
+   first l symbols, which the suffix array of W settles, and then by the rank
+   of the suffix l symbols later. Stores the block offsets into SA[0..l-1];
+   SA must hold 2l entries and PLCP is scratch of 2l entries. */
+static void ext_sort_block(const unsigned char *W, int32_t l, const int32_t *rank_next, int32_t *SA, int32_t *PLCP, unsigned threads) noexcept {
+  const int32_t w = 2 * l;
+  int32_t i, j, h, k, lcp, group;
+
+  suffix_sort(W, SA, w, threads);
+
+  /* Longest common prefixes by the Phi array. */
+  PLCP[SA[0]] = -1;
+  for(i = 1; i < w; ++i) { PLCP[SA[i]] = SA[i - 1]; }
+  for(i = 0, h = 0; i < w; ++i) {
+    if((j = PLCP[i]) < 0) { PLCP[i] = h = 0; continue; }
+    while(((i + h) < w) && ((j + h) < w) && (W[i + h] == W[j + h])) { ++h; }
+    PLCP[i] = h;
+    if(0 < h) { --h; }
+  }
+
+  /* Keep the block suffixes and sort each run sharing l symbols by rank. */
+  for(i = 0, k = 0, lcp = w, group = 0; i < w; ++i) {
+    if(0 < i) { lcp = std::min(lcp, PLCP[SA[i]]); }
+    if(SA[i] < l) {
+      if((0 < k) && (lcp < l)) {
+        if(1 < (k - group)) {
+          std::sort(SA + group, SA + k, [&](int32_t a, int32_t b) { return rank_next[a] < rank_next[b]; });
+        }
+        group = k;
+      }
+      SA[k++] = SA[i], lcp = w;
+    }
+  }
+  if(1 < (k - group)) {
+    std::sort(SA + group, SA + k, [&](int32_t a, int32_t b) { return rank_next[a] < rank_next[b]; });
+  }
+}
+
+} // namespace divss::internal
+
+/*---------------------------------------------------------------------------*/
+
+namespace divss {
+
+/*- Function -*/
+
+/* Constructs the suffix array of the file input_path into output_path, as
+   n consecutive ResultT values, using at most about ram bytes of heap. The text is
+   cut into blocks processed from its end; the suffixes of each block are
+   sorted in memory, their gap array against the suffixes already sorted is
+   computed by a backward scan of the text, and both are merged into a new
+   suffix array file. All disk I/O is sequential and overlaps with the
+   computation. Temporary files are created next to output_path.
+   Returns 0 on success, -1 for bad arguments or files that cannot be opened
+   and -2 for I/O errors or too small a memory budget. */
+template <typename ResultT = int64_t> int32_t suffix_sort_external(const char *input_path, const char *output_path, std::size_t ram, unsigned threads = 1) {
+  using internal::ext_input;
+  using internal::ext_output;
+  using internal::ext_bit_input;
+  using internal::ext_bit_output;
+  constexpr int32_t occ_interval = EXT_OCC_INTERVAL;
+  struct stat st;
+  int fd, fds[5];
+  int64_t n, b, e, t, L;
+  int32_t status = 0;
+
+  /* Check arguments. */
+  if((input_path == nullptr) || (output_path == nullptr)) { return -1; }
+  if((fd = ::open(input_path, O_RDONLY)) < 0) { return -1; }
+  if((::fstat(fd, &st) != 0) || ((n = st.st_size) < 0) ||
+     (static_cast<int64_t>(std::numeric_limits<ResultT>::max()) < n)) { ::close(fd); return -1; }
+
+  /* At most EXT_STREAMS files are streamed at once, each through two chunks
+     of a 64th of the budget (4 KiB to EXT_CHUNKSIZE). The rest is 26 bytes
+     per block symbol at the peak, while the gap array is computed: the block
+     and its BWT (1 byte each), SA and ISA (4 bytes each), occ and gap (8
+     bytes each). Sorting a block takes at most 24: W, SA and PLCP over 2l
+     symbols, rank_next and the compacted copy of W made by suffix_sort.
+     Blocks stay below 2^30 so that ext_sort_block sorts 2l symbols with
+     int32_t. */
+  const std::size_t chunk = std::clamp<std::size_t>(ram / 64, 4096, EXT_CHUNKSIZE);
+  if(ram < 2 * EXT_STREAMS * chunk) { ::close(fd); return -2; }
+  L = std::min<int64_t>(static_cast<int64_t>((ram - 2 * EXT_STREAMS * chunk) / 26), (int64_t{1} << 30) - 1);
+  if(L < 512) { ::close(fd); return -2; }
+  L = std::min(L, std::max<int64_t>(n, 1));
+
+  /* Temporary suffix array and gt bit files, two of each, and the output. */
+  const std::string base = output_path;
+  const std::string names[4] = {base + ".sa0", base + ".sa1", base + ".gt0", base + ".gt1"};
+  for(int f = 0; f < 4; ++f) { fds[f] = ::open(names[f].c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644); }
+  fds[4] = ::open(output_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  auto cleanup = [&]() {
+    for(int f = 0; f < 5; ++f) { if(0 <= fds[f]) { ::close(fds[f]); } }
+    for(int f = 0; f < 4; ++f) { std::remove(names[f].c_str()); }
+    ::close(fd);
+  };
+  for(int f = 0; f < 5; ++f) { if(fds[f] < 0) { cleanup(); return -1; } }
+  if(n == 0) { cleanup(); return 0; }
+
+  std::vector<unsigned char> W;
+  std::vector<int32_t> SA, PLCP, ISA, rank_next;
+  std::vector<unsigned char> BWT;
+  std::vector<uint32_t> occ;
+  std::vector<int64_t> gap;
+  int round = 0;
+
+  /* Blocks of L symbols from the end; the first block may be shorter. */
+  for(e = n; 0 < e; e = b, ++round) {
+    const bool last_round = ((b = std::max<int64_t>(0, e - L)) == 0);
+    const int32_t l = static_cast<int32_t>(e - b);
+    const int sa_in = fds[round & 1], sa_out = last_round ? fds[4] : fds[(round + 1) & 1];
+    const int gt_in = fds[2 + (round & 1)], gt_out = fds[2 + ((round + 1) & 1)];
+
+    /* Sort the suffixes of the block. */
+    if(e == n) {
+      W.resize(static_cast<std::size_t>(l)), SA.resize(static_cast<std::size_t>(l));
+      if(!internal::ext_pread(fd, W.data(), W.size(), b)) { status = -2; break; }
+      suffix_sort(W.data(), SA.data(), l, threads);
+    } else {
+      W.resize(2 * static_cast<std::size_t>(l)), SA.resize(2 * static_cast<std::size_t>(l)), PLCP.resize(2 * static_cast<std::size_t>(l));
+      if(!internal::ext_pread(fd, W.data(), W.size(), b)) { status = -2; break; }
+      internal::ext_sort_block(W.data(), l, rank_next.data(), SA.data(), PLCP.data(), threads);
+      PLCP = std::vector<int32_t>(), rank_next = std::vector<int32_t>();
+      SA.resize(static_cast<std::size_t>(l)), W.resize(static_cast<std::size_t>(l));
+      SA.shrink_to_fit(), W.shrink_to_fit();
+    }
+    ISA.resize(static_cast<std::size_t>(l));
+    for(int32_t i = 0; i < l; ++i) { ISA[SA[i]] = i; }
+
+    ext_bit_output gt(gt_out, chunk);
+    gap.assign(static_cast<std::size_t>(l) + 1, 0);
+    if(e < n) {
+      /* The gap array: the rank of each later suffix among the block ones,
+         by backward search over the block's BWT. */
+      std::array<int64_t, 257> C{};
+      int32_t dummy = 0;
+      BWT.resize(static_cast<std::size_t>(l));
+      for(int32_t i = 0; i < l; ++i) {
+        if(0 < SA[i]) { BWT[i] = W[SA[i] - 1]; }
+        else { BWT[i] = 0, dummy = i; }
+        ++C[W[i] + 1];
+      }
+      for(int c = 0; c < 256; ++c) { C[c + 1] += C[c]; }
+      /* occ[k * 256 + c] counts c in BWT[0..k * occ_interval). */
+      occ.assign((static_cast<std::size_t>(l) / occ_interval + 1) * 256, 0);
+      for(int32_t i = 0; i < l; ++i) {
+        if((0 < i) && ((i % occ_interval) == 0)) {
+          std::copy_n(occ.begin() + (i / occ_interval - 1) * 256, 256, occ.begin() + (i / occ_interval) * 256);
+        }
+        ++occ[(i / occ_interval) * 256 + BWT[i]];
+      }
+      for(std::size_t k = occ.size() / 256 - 1; 0 < k; --k) {
+        std::copy_n(occ.begin() + (k - 1) * 256, 256, occ.begin() + k * 256);
+      }
+      std::fill_n(occ.begin(), 256, 0);
+      auto rank = [&](int c, int32_t r) -> int64_t {
+        int32_t k = r / occ_interval;
+        int64_t count = occ[static_cast<std::size_t>(k) * 256 + c];
+        for(int32_t i = k * occ_interval; i < r; ++i) { count += (BWT[i] == c); }
+        if((c == 0) && (dummy < r)) { --count; }
+        return count;
+      };
+
+      ext_input<unsigned char> text(fd, e, n, true, chunk);
+      ext_bit_input gt_next(gt_in, n - e, chunk);
+      const int lastc = W[l - 1];
+      const int32_t rank_b = ISA[0];
+      int32_t r = 0;
+      bool g = false;
+      unsigned char c;
+      for(t = n - 1; e <= t; --t) {
+        if(!text.get(c)) { status = -2; break; }
+        r = static_cast<int32_t>(C[c] + rank(c, r) + (((c == lastc) && g) ? 1 : 0));
+        ++gap[r];
+        gt.put(rank_b < r);
+        g = gt_next.get();
+      }
+      if((status != 0) || text.failed() || gt_next.failed()) { status = -2; break; }
+      BWT = std::vector<unsigned char>(), occ = std::vector<uint32_t>();
+    }
+    for(int32_t i = l - 1; 0 <= i; --i) { gt.put(ISA[0] < ISA[i]); }
+    if(!gt.close()) { status = -2; break; }
+
+    /* Merge the block suffixes into the suffixes already sorted. */
+    {
+      ext_input<ResultT> prev(sa_in, 0, n - e, false, chunk);
+      ext_output<ResultT> out(sa_out, chunk);
+      ResultT v;
+      for(int32_t i = 0; i <= l; ++i) {
+        for(int64_t g = gap[i]; 0 < g; --g) {
+          if(!prev.get(v)) { status = -2; break; }
+          out.put(v);
+        }
+        if(i < l) { out.put(static_cast<ResultT>(b + SA[i])); }
+      }
+      if(!out.close() || prev.failed()) { status = -2; }
+    }
+    if(status != 0) { break; }
+
+    gap = std::vector<int64_t>();
+    rank_next.swap(ISA);
+  }
+
+  cleanup();
+  if(status != 0) { std::remove(output_path); }
+  return status;
+}
+
+} // namespace divss
+
+#endif
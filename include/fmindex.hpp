@@ -0,0 +1,481 @@
+#ifndef LIBDIVSUFSORT_FMINDEX_HPP
+#define LIBDIVSUFSORT_FMINDEX_HPP
+
+#include "divsufsort.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#define FM_SAMPLE_RATE (32)
+#define FM_SUPERBLOCK (65536) /* blocks per superblock of the DNA rank */
+
+namespace divss::internal {
+
+/*- Private Classes -*/
+
+/* Allocator returning cache-line aligned storage, so that a 64-byte rank
+   block never straddles two lines. */
+template <typename T> struct fm_aligned_allocator {
+  using value_type = T;
+  fm_aligned_allocator() noexcept = default;
+  template <typename U> fm_aligned_allocator(const fm_aligned_allocator<U> &) noexcept { }
+  T *allocate(std::size_t n) { return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t{64})); }
+  void deallocate(T *p, std::size_t) noexcept { ::operator delete(p, std::align_val_t{64}); }
+  template <typename U> bool operator==(const fm_aligned_allocator<U> &) const noexcept { return true; }
+};
+
+template <typename T> using fm_vector = std::vector<T, fm_aligned_allocator<T>>;
+
+template <typename T> static bool fm_write(std::FILE *fp, const T *p, std::size_t n) noexcept {
+  return (n == 0) || (std::fwrite(p, sizeof(T), n, fp) == n);
+}
+template <typename T> static bool fm_read(std::FILE *fp, T *p, std::size_t n) noexcept {
+  return (n == 0) || (std::fread(p, sizeof(T), n, fp) == n);
+}
+template <typename V> static bool fm_write_vector(std::FILE *fp, const V & v) noexcept {
+  uint64_t size = v.size();
+  return fm_write(fp, &size, 1) && fm_write(fp, v.data(), v.size());
+}
+/* Reads a vector written by fm_write_vector, failing if it has more than
+   max elements or, when fp is seekable, more than the rest of the file. */
+template <typename V> static bool fm_read_vector(std::FILE *fp, V & v, uint64_t max = UINT64_MAX) {
+  uint64_t size;
+  long pos, end;
+  if(!fm_read(fp, &size, 1) || (max < size)) { return false; }
+  if((0 <= (pos = std::ftell(fp))) && (std::fseek(fp, 0, SEEK_END) == 0)) {
+    end = std::ftell(fp);
+    if((std::fseek(fp, pos, SEEK_SET) != 0) || (end < pos) || ((static_cast<uint64_t>(end - pos) / sizeof(typename V::value_type)) < size)) { return false; }
+  }
+  v.resize(static_cast<std::size_t>(size));
+  return fm_read(fp, v.data(), v.size());
+}
+
+/* Bit vector with rank. Each 64-byte block holds the number of ones before
+   it followed by 448 bits, so a rank reads one cache line. */
+class fm_bitvector {
+  fm_vector<uint64_t> data_;
+
+public:
+  void resize(uint64_t n) { data_.assign((n / 448 + 1) * 8, 0); }
+  void set(uint64_t i) noexcept { data_[(i / 448) * 8 + 1 + (i % 448) / 64] |= uint64_t{1} << (i % 64); }
+  bool get(uint64_t i) const noexcept { return (data_[(i / 448) * 8 + 1 + (i % 448) / 64] >> (i % 64)) & 1; }
+
+  /* Fills in the block counts once all bits are set. */
+  void finish() noexcept {
+    uint64_t b, k, c;
+    for(b = 0, c = 0; b < data_.size(); b += 8) {
+      data_[b] = c;
+      for(k = 1; k < 8; ++k) { c += std::popcount(data_[b + k]); }
+    }
+  }
+
+  /* Number of ones in [0, i). */
+  uint64_t rank1(uint64_t i) const noexcept {
+    const uint64_t *p = &data_[(i / 448) * 8];
+    uint64_t r = i % 448, c = p[0], k;
+    for(k = 0; k < r / 64; ++k) { c += std::popcount(p[1 + k]); }
+    if(r % 64) { c += std::popcount(p[1 + k] & ((uint64_t{1} << (r % 64)) - 1)); }
+    return c;
+  }
+  uint64_t rank0(uint64_t i) const noexcept { return i - rank1(i); }
+
+  std::size_t size_in_bytes() const noexcept { return data_.size() * sizeof(uint64_t); }
+  bool save(std::FILE *fp) const noexcept { return fm_write_vector(fp, data_); }
+  /* Reads the bits of a vector of n bits and checks its block counts. */
+  bool load(std::FILE *fp, uint64_t n) {
+    const uint64_t size = (n / 448 + 1) * 8;
+    uint64_t b, k, c;
+    if(!fm_read_vector(fp, data_, size) || (data_.size() != size)) { return false; }
+    for(b = 0, c = 0; b < size; b += 8) {
+      if(data_[b] != c) { return false; }
+      for(k = 1; k < 8; ++k) { c += std::popcount(data_[b + k]); }
+    }
+    return true;
+  }
+};
+
+/* Rank over an alphabet of at most 4 symbols (DNA). Each 64-byte block holds
+   the counts of the 4 symbols before it, relative to its superblock of
+   FM_SUPERBLOCK blocks, and 192 symbols of 2 bits; access and rank both read
+   one cache line. */
+class fm_rank4 {
+  fm_vector<uint64_t> data_;
+  std::vector<uint64_t> super_;
+
+  /* Marks the low bit of each 2-bit field of w equal to c. */
+  static uint64_t match(uint64_t w, uint32_t c) noexcept {
+    uint64_t x = w ^ (c * uint64_t{0x5555555555555555});
+    return ~(x | (x >> 1)) & uint64_t{0x5555555555555555};
+  }
+
+public:
+  void build(const unsigned char *S, uint64_t n) {
+    uint64_t b, i, cnt[4] = {0, 0, 0, 0};
+    data_.assign((n / 192 + 1) * 8, 0);
+    super_.assign((n / 192 / FM_SUPERBLOCK + 1) * 4, 0);
+    for(b = 0; b * 192 <= n; ++b) {
+      if((b % FM_SUPERBLOCK) == 0) { std::copy(cnt, cnt + 4, &super_[(b / FM_SUPERBLOCK) * 4]); }
+      uint32_t *rel = reinterpret_cast<uint32_t *>(&data_[b * 8]);
+      for(uint32_t c = 0; c < 4; ++c) { rel[c] = static_cast<uint32_t>(cnt[c] - super_[(b / FM_SUPERBLOCK) * 4 + c]); }
+      for(i = b * 192; (i < n) && (i < (b + 1) * 192); ++i) {
+        data_[b * 8 + 2 + (i % 192) / 32] |= uint64_t{S[i]} << (2 * (i % 32));
+        ++cnt[S[i]];
+      }
+    }
+  }
+
+  uint32_t access(uint64_t i) const noexcept {
+    return (data_[(i / 192) * 8 + 2 + (i % 192) / 32] >> (2 * (i % 32))) & 3;
+  }
+
+  /* Number of occurrences of c in [0, i). */
+  uint64_t rank(uint32_t c, uint64_t i) const noexcept {
+    const uint64_t *p = &data_[(i / 192) * 8];
+    uint64_t r = i % 192, k, h = super_[(i / 192 / FM_SUPERBLOCK) * 4 + c] + reinterpret_cast<const uint32_t *>(p)[c];
+    for(k = 0; k < r / 32; ++k) { h += std::popcount(match(p[2 + k], c)); }
+    if(r % 32) { h += std::popcount(match(p[2 + k], c) & ((uint64_t{1} << (2 * (r % 32))) - 1)); }
+    return h;
+  }
+
+  std::size_t size_in_bytes() const noexcept { return (data_.size() + super_.size()) * sizeof(uint64_t); }
+  bool save(std::FILE *fp) const noexcept { return fm_write_vector(fp, data_) && fm_write_vector(fp, super_); }
+  /* Reads the blocks of n symbols and checks their counts. */
+  bool load(std::FILE *fp, uint64_t n) {
+    const uint64_t size = (n / 192 + 1) * 8, super = (n / 192 / FM_SUPERBLOCK + 1) * 4;
+    uint64_t b, i, cnt[4] = {0, 0, 0, 0};
+    if(!fm_read_vector(fp, data_, size) || (data_.size() != size) || !fm_read_vector(fp, super_, super) || (super_.size() != super)) { return false; }
+    for(b = 0; b * 192 <= n; ++b) {
+      const uint32_t *rel = reinterpret_cast<const uint32_t *>(&data_[b * 8]);
+      for(uint32_t c = 0; c < 4; ++c) {
+        if(super_[(b / FM_SUPERBLOCK) * 4 + c] + rel[c] != cnt[c]) { return false; }
+      }
+      for(i = b * 192; (i < n) && (i < (b + 1) * 192); ++i) { ++cnt[access(i)]; }
+    }
+    return true;
+  }
+};
+
+/* Wavelet matrix over an alphabet of up to 256 symbols: one fm_bitvector per
+   bit of the symbols, most significant first, with the zeros of each level
+   placed before the ones on the next. */
+class fm_wavelet_matrix {
+  std::vector<fm_bitvector> levels_;
+  std::vector<uint64_t> zeros_, start_;
+
+public:
+  void build(const unsigned char *S, uint64_t n, int32_t sigma) {
+    int32_t L = std::max<int32_t>(std::bit_width(static_cast<uint32_t>(sigma - 1)), 1), l;
+    std::vector<unsigned char> cur(S, S + n), next(n);
+    uint64_t i, z, o;
+
+    levels_.assign(L, fm_bitvector{}), zeros_.assign(L, 0), start_.assign(sigma, 0);
+    for(l = 0; l < L; ++l) {
+      const int32_t s = L - 1 - l;
+      levels_[l].resize(n);
+      for(i = 0, z = 0; i < n; ++i) {
+        if((cur[i] >> s) & 1) { levels_[l].set(i); } else { ++z; }
+      }
+      levels_[l].finish();
+      zeros_[l] = z;
+      for(i = 0, o = z, z = 0; i < n; ++i) {
+        if((cur[i] >> s) & 1) { next[o++] = cur[i]; } else { next[z++] = cur[i]; }
+      }
+      std::swap(cur, next);
+    }
+
+    /* Start of the occurrences of each symbol on the last level. */
+    for(int32_t c = 0; c < sigma; ++c) {
+      for(l = 0, z = 0; l < L; ++l) {
+        z = ((c >> (L - 1 - l)) & 1) ? zeros_[l] + levels_[l].rank1(z) : levels_[l].rank0(z);
+      }
+      start_[c] = z;
+    }
+  }
+
+  /* Number of occurrences of c in [0, i). */
+  uint64_t rank(uint32_t c, uint64_t i) const noexcept {
+    const int32_t L = static_cast<int32_t>(levels_.size());
+    for(int32_t l = 0; l < L; ++l) {
+      i = ((c >> (L - 1 - l)) & 1) ? zeros_[l] + levels_[l].rank1(i) : levels_[l].rank0(i);
+    }
+    return i - start_[c];
+  }
+
+  /* Same as rank for both i and j; the two chains of cache misses overlap. */
+  void rank_pair(uint32_t c, uint64_t & i, uint64_t & j) const noexcept {
+    const int32_t L = static_cast<int32_t>(levels_.size());
+    for(int32_t l = 0; l < L; ++l) {
+      if((c >> (L - 1 - l)) & 1) { i = zeros_[l] + levels_[l].rank1(i), j = zeros_[l] + levels_[l].rank1(j); }
+      else { i = levels_[l].rank0(i), j = levels_[l].rank0(j); }
+    }
+    i -= start_[c], j -= start_[c];
+  }
+
+  /* Returns the symbol c at i and sets r to the number of occurrences of c
+     in [0, i), in one pass over the levels. */
+  uint32_t access_rank(uint64_t i, uint64_t & r) const noexcept {
+    uint32_t c = 0;
+    for(std::size_t l = 0; l < levels_.size(); ++l) {
+      const uint32_t b = levels_[l].get(i);
+      i = b ? zeros_[l] + levels_[l].rank1(i) : levels_[l].rank0(i);
+      c = (c << 1) | b;
+    }
+    r = i - start_[c];
+    return c;
+  }
+
+  std::size_t size_in_bytes() const noexcept {
+    std::size_t size = (zeros_.size() + start_.size()) * sizeof(uint64_t);
+    for(const fm_bitvector & v: levels_) { size += v.size_in_bytes(); }
+    return size;
+  }
+  bool save(std::FILE *fp) const noexcept {
+    if(!fm_write_vector(fp, zeros_) || !fm_write_vector(fp, start_)) { return false; }
+    for(const fm_bitvector & v: levels_) { if(!v.save(fp)) { return false; } }
+    return true;
+  }
+  /* Reads the matrix of n symbols out of sigma and checks its counts. */
+  bool load(std::FILE *fp, uint64_t n, int32_t sigma) {
+    const uint64_t L = static_cast<uint64_t>(std::max<int32_t>(std::bit_width(static_cast<uint32_t>(sigma - 1)), 1));
+    if(!fm_read_vector(fp, zeros_, L) || (zeros_.size() != L) || !fm_read_vector(fp, start_, sigma) || (start_.size() != static_cast<uint64_t>(sigma))) { return false; }
+    levels_.assign(L, fm_bitvector{});
+    for(uint64_t l = 0; l < L; ++l) {
+      if(!levels_[l].load(fp, n) || (zeros_[l] != levels_[l].rank0(n))) { return false; }
+    }
+    for(int32_t c = 0; c < sigma; ++c) {
+      uint64_t z = 0;
+      for(uint64_t l = 0; l < L; ++l) {
+        z = ((c >> (L - 1 - l)) & 1) ? zeros_[l] + levels_[l].rank1(z) : levels_[l].rank0(z);
+      }
+      if(start_[c] != z) { return false; }
+    }
+    return true;
+  }
+};
+
+} // namespace divss::internal
+
+/*---------------------------------------------------------------------------*/
+
+/*- Class -*/
+
+namespace divss {
+
+/* FM-index of a byte text, built from its Burrows-Wheeler transform as
+   produced by divbwt. The transform is held by a rank structure over the
+   symbols of the text: 2 bits per symbol in cache-line blocks when the text
+   has at most 4 distinct symbols (DNA), a wavelet matrix of cache-line
+   blocked bit vectors otherwise. count takes O(m) ranks for a pattern of m
+   symbols; locate walks each occurrence back through LF to the nearest row
+   whose suffix array entry is kept, one row in sample_rate being sampled
+   (about sample_rate steps on average). A DNA index with the default rate of
+   FM_SAMPLE_RATE takes about 0.46n bytes for 32-bit indices, against 5n for
+   T and SA; other alphabets take 1.14 bits per level of the wavelet matrix
+   and symbol. Rows are those of the transform with the sentinel, the row of
+   the sentinel being the primary index returned by divbwt. */
+template <typename CharT = unsigned char, typename ResultT = int32_t> class fm_index {
+  static_assert(!large_alphabet<CharT>, "fm_index handles byte alphabets");
+
+  ResultT n_ = 0, pidx_ = 0, rate_ = FM_SAMPLE_RATE;
+  int32_t sigma_ = 0;
+  std::array<int32_t, 256> code_{};
+  std::vector<ResultT> C_;
+  internal::fm_rank4 dna_;
+  internal::fm_wavelet_matrix wm_;
+  std::vector<ResultT> samples_;
+
+  /* Row of the suffix one position before the suffix of row r (r is not the
+     primary index). */
+  int64_t LF(int64_t r) const noexcept {
+    uint64_t k;
+    int32_t c;
+    if(pidx_ < r) { --r; }
+    if(sigma_ <= 4) { c = static_cast<int32_t>(dna_.access(r)), k = dna_.rank(c, r); }
+    else { c = static_cast<int32_t>(wm_.access_rank(r, k)); }
+    return static_cast<int64_t>(C_[c]) + static_cast<int64_t>(k);
+  }
+
+  /* Backward search: sets [sp, ep) to the rows prefixed by P[0..m-1]. */
+  void range(const CharT *P, ResultT m, int64_t & sp, int64_t & ep) const noexcept {
+    int32_t c;
+    sp = (0 < m) ? 0 : 1, ep = static_cast<int64_t>(n_) + 1;
+    for(ResultT i = m; (0 < i) && (sp < ep); --i) {
+      if((c = code_[static_cast<unsigned char>(P[i - 1])]) < 0) { sp = ep = 0; return; }
+      /* Occurrences of c in the rows [0, sp) and [0, ep). */
+      uint64_t s = static_cast<uint64_t>(sp - (pidx_ < sp)), e = static_cast<uint64_t>(ep - (pidx_ < ep));
+      if(sigma_ <= 4) { s = dna_.rank(c, s), e = dna_.rank(c, e); } else { wm_.rank_pair(c, s, e); }
+      sp = C_[c] + static_cast<int64_t>(s), ep = C_[c] + static_cast<int64_t>(e);
+    }
+  }
+
+  /* Builds the rank structure and C from U, mapping the symbols to codes. */
+  void build_rank(const CharT *U, ResultT n) {
+    std::array<int64_t, 256> count{};
+    std::vector<unsigned char> S(n);
+    int32_t c;
+    int64_t i;
+
+    for(i = 0; i < n; ++i) { ++count[static_cast<unsigned char>(U[i])]; }
+    for(c = 0, sigma_ = 0; c < 256; ++c) { code_[c] = (0 < count[c]) ? sigma_++ : -1; }
+    C_.assign(sigma_ + 1, 0);
+    for(c = 0, i = 1; c < 256; ++c) {
+      if(0 <= code_[c]) { C_[code_[c]] = static_cast<ResultT>(i), i += count[c]; }
+    }
+    C_[sigma_] = static_cast<ResultT>(i);
+    for(i = 0; i < n; ++i) { S[i] = static_cast<unsigned char>(code_[static_cast<unsigned char>(U[i])]); }
+    if(sigma_ <= 4) { dna_.build(S.data(), n); } else { wm_.build(S.data(), n, sigma_); }
+  }
+
+  /* Reads what save writes after the magic and checks it: the header, the
+     size and the counts of every part against it, and C against the
+     symbol counts. */
+  bool read(std::FILE *fp) {
+    int64_t header[4];
+    int32_t c;
+    if(!internal::fm_read(fp, header, 4)) { return false; }
+    if((header[0] < 0) || (static_cast<int64_t>(std::numeric_limits<ResultT>::max()) <= header[0]) ||
+       (header[1] < 0) || (header[0] < header[1]) || (header[2] < 1) ||
+       (header[3] < ((0 < header[0]) ? 1 : 0)) || (256 < header[3])) {
+      return false;
+    }
+    n_ = static_cast<ResultT>(header[0]), pidx_ = static_cast<ResultT>(header[1]), rate_ = static_cast<ResultT>(header[2]), sigma_ = static_cast<int32_t>(header[3]);
+
+    const uint64_t n = static_cast<uint64_t>(n_), samples = static_cast<uint64_t>(n_ / rate_) + 1;
+    if(!internal::fm_read(fp, code_.data(), code_.size()) ||
+       !internal::fm_read_vector(fp, C_, sigma_ + 1) || (C_.size() != static_cast<std::size_t>(sigma_ + 1)) ||
+       !((sigma_ <= 4) ? dna_.load(fp, n) : wm_.load(fp, n, sigma_)) ||
+       !internal::fm_read_vector(fp, samples_, samples) || (samples_.size() != samples)) {
+      return false;
+    }
+    if(std::any_of(code_.begin(), code_.end(), [this](int32_t x) { return (x < -1) || (sigma_ <= x); })) { return false; }
+    if((C_[0] != 1) || (C_[sigma_] != n_ + 1)) { return false; }
+    for(c = 0; c < sigma_; ++c) {
+      const uint64_t k = (sigma_ <= 4) ? dna_.rank(c, n) : wm_.rank(c, n);
+      if((C_[c + 1] < C_[c]) || (static_cast<uint64_t>(C_[c + 1] - C_[c]) != k)) { return false; }
+    }
+    return true;
+  }
+
+public:
+  /* Builds the index of T[0..n-1], sorting its suffixes with `threads`
+     threads. Returns 0 on success and -1 for bad arguments. */
+  int32_t build(const CharT *T, no_deduce<ResultT> n, no_deduce<ResultT> sample_rate = FM_SAMPLE_RATE, unsigned threads = 1) {
+    if((T == nullptr) || (n < 0) || (sample_rate < 1) || (n == std::numeric_limits<ResultT>::max())) { return -1; }
+
+    std::vector<ResultT> SA(n);
+    std::vector<CharT> U(n);
+    ResultT i, j;
+
+    if(0 < n) { suffix_sort(T, SA.data(), n, threads); }
+    n_ = n, rate_ = sample_rate, pidx_ = 0;
+    if(0 < n) { U[0] = T[n - 1]; }
+    for(i = 0, j = 1; i < n; ++i) {
+      if(SA[i] == 0) { pidx_ = i + 1; } else { U[j++] = T[SA[i] - 1]; }
+    }
+    build_rank(U.data(), n);
+
+    /* Sample every rate-th row; row 0 is the suffix n. */
+    samples_.assign(static_cast<std::size_t>(n / rate_) + 1, n);
+    for(i = rate_ - 1; i < n; i += rate_) { samples_[(i + 1) / rate_] = SA[i]; }
+    return 0;
+  }
+
+  /* Builds the index from the output U[0..n-1] and pidx of divbwt. The
+     suffix array samples are recovered by walking the text backward through
+     LF. Returns 0 on success and -1 for bad arguments. */
+  int32_t build_from_bwt(const CharT *U, no_deduce<ResultT> n, no_deduce<ResultT> pidx, no_deduce<ResultT> sample_rate = FM_SAMPLE_RATE) {
+    if((U == nullptr) || (n < 0) || (sample_rate < 1) || (n == std::numeric_limits<ResultT>::max()) ||
+       (pidx < 0) || (n < pidx) || ((0 < n) && (pidx == 0))) {
+      return -1;
+    }
+
+    n_ = n, pidx_ = pidx, rate_ = sample_rate;
+    build_rank(U, n);
+
+    /* Visit the rows from the last suffix to the first. */
+    samples_.assign(static_cast<std::size_t>(n / rate_) + 1, n);
+    for(int64_t j = static_cast<int64_t>(n) - 1, r = 0; 0 <= j; --j) {
+      r = LF(r);
+      if((r % rate_) == 0) { samples_[r / rate_] = static_cast<ResultT>(j); }
+    }
+    return 0;
+  }
+
+  ResultT size() const noexcept { return n_; }
+
+  /* Returns the number of occurrences of P[0..m-1] in the text, or -1 for
+     bad arguments. */
+  ResultT count(const CharT *P, no_deduce<ResultT> m) const noexcept {
+    int64_t sp, ep;
+    if(((P == nullptr) && (0 < m)) || (m < 0)) { return -1; }
+    range(P, m, sp, ep);
+    return static_cast<ResultT>(std::max<int64_t>(ep - sp, 0));
+  }
+
+  /* Finds the occurrences of P[0..m-1] and stores the first `size` of their
+     text positions, in suffix array order, into occ. Returns the number of
+     occurrences, or -1 for bad arguments. */
+  ResultT locate(const CharT *P, no_deduce<ResultT> m, ResultT *occ, no_deduce<ResultT> size) const noexcept {
+    int64_t sp, ep, r, d;
+    if(((P == nullptr) && (0 < m)) || (m < 0) || ((occ == nullptr) && (0 < size))) { return -1; }
+    range(P, m, sp, ep);
+    for(int64_t i = sp; (i < ep) && ((i - sp) < size); ++i) {
+      for(r = i, d = 0; ((r % rate_) != 0) && (r != pidx_); r = LF(r), ++d) { }
+      occ[i - sp] = static_cast<ResultT>(((r == pidx_) ? 0 : static_cast<int64_t>(samples_[r / rate_])) + d);
+    }
+    return static_cast<ResultT>(std::max<int64_t>(ep - sp, 0));
+  }
+
+  std::vector<ResultT> locate(std::span<const CharT> P) const {
+    std::vector<ResultT> occ(count(P.data(), static_cast<ResultT>(P.size())));
+    locate(P.data(), static_cast<ResultT>(P.size()), occ.data(), static_cast<ResultT>(occ.size()));
+    return occ;
+  }
+
+  /* Size of the index in bytes. */
+  std::size_t size_in_bytes() const noexcept {
+    return sizeof(*this) + C_.size() * sizeof(ResultT) + dna_.size_in_bytes() + wm_.size_in_bytes() +
+           samples_.size() * sizeof(ResultT);
+  }
+
+  /* Writes the index to fp. Returns 0 on success and -2 on a write error. */
+  int32_t save(std::FILE *fp) const noexcept {
+    const char magic[8] = {'D', 'S', 'S', 'F', 'M', 'I', '1', static_cast<char>(sizeof(ResultT))};
+    const int64_t header[4] = {n_, pidx_, rate_, sigma_};
+    if((fp == nullptr) || !internal::fm_write(fp, magic, 8) || !internal::fm_write(fp, header, 4) ||
+       !internal::fm_write(fp, code_.data(), code_.size()) || !internal::fm_write_vector(fp, C_) ||
+       !((sigma_ <= 4) ? dna_.save(fp) : wm_.save(fp)) || !internal::fm_write_vector(fp, samples_)) {
+      return -2;
+    }
+    return 0;
+  }
+
+  /* Reads an index written by save. Returns 0 on success, -1 if fp does not
+     hold an index with this ResultT and -2 on a read error, on a corrupt or
+     truncated index and if it does not fit in memory. The index is left
+     unchanged unless it succeeds. */
+  int32_t load(std::FILE *fp) noexcept {
+    const char expected[8] = {'D', 'S', 'S', 'F', 'M', 'I', '1', static_cast<char>(sizeof(ResultT))};
+    char magic[8];
+    if((fp == nullptr) || !internal::fm_read(fp, magic, 8)) { return -2; }
+    if(!std::equal(magic, magic + 8, expected)) { return -1; }
+    try {
+      fm_index index;
+      if(!index.read(fp)) { return -2; }
+      *this = std::move(index);
+    } catch(const std::bad_alloc &) {
+      return -2;
+    } catch(const std::length_error &) {
+      return -2;
+    }
+    return 0;
+  }
+};
+
+} // namespace divss
+
+#endif
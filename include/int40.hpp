@@ -0,0 +1,73 @@
+#ifndef LIBDIVSUFSORT_INT40_HPP
+#define LIBDIVSUFSORT_INT40_HPP
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+namespace divss {
+
+/* Packed 40-bit signed index, usable as ResultT. It occupies 5 bytes, so a
+   suffix array of n entries takes 5n bytes instead of 8n with int64_t, and
+   reaches texts of up to 2^39 - 1 symbols. Values are stored in two's
+   complement, so the sign-bit marking (~i) of the sort kernels keeps working;
+   all arithmetic is done on int64_t. */
+class int40_t {
+  uint8_t b[5];
+
+public:
+  int40_t() noexcept = default;
+  constexpr int40_t(int64_t v) noexcept: b{} {
+    if(std::is_constant_evaluated() || (std::endian::native != std::endian::little)) {
+      for(int i = 0; i < 5; ++i) { b[i] = static_cast<uint8_t>(v >> (8 * i)); }
+    } else {
+      std::memcpy(b, &v, 5);
+    }
+  }
+
+  constexpr operator int64_t() const noexcept {
+    if(std::is_constant_evaluated() || (std::endian::native != std::endian::little)) {
+      uint64_t v = 0;
+      for(int i = 0; i < 5; ++i) { v |= static_cast<uint64_t>(b[i]) << (8 * i); }
+      return static_cast<int64_t>(v << 24) >> 24;
+    } else {
+      uint32_t lo;
+      int8_t hi;
+      std::memcpy(&lo, b, 4), std::memcpy(&hi, b + 4, 1);
+      return (static_cast<int64_t>(hi) * (int64_t{1} << 32)) | lo;
+    }
+  }
+
+  constexpr int40_t & operator++() noexcept { return *this = *this + 1; }
+  constexpr int40_t & operator--() noexcept { return *this = *this - 1; }
+  constexpr int40_t operator++(int) noexcept { int40_t t = *this; ++*this; return t; }
+  constexpr int40_t operator--(int) noexcept { int40_t t = *this; --*this; return t; }
+  constexpr int40_t & operator+=(int64_t v) noexcept { return *this = *this + v; }
+  constexpr int40_t & operator-=(int64_t v) noexcept { return *this = *this - v; }
+  constexpr int40_t & operator*=(int64_t v) noexcept { return *this = *this * v; }
+  constexpr int40_t & operator/=(int64_t v) noexcept { return *this = *this / v; }
+  constexpr int40_t & operator>>=(int v) noexcept { return *this = *this >> v; }
+  constexpr int40_t & operator<<=(int v) noexcept { return *this = *this << v; }
+  constexpr int40_t & operator&=(int64_t v) noexcept { return *this = *this & v; }
+  constexpr int40_t & operator|=(int64_t v) noexcept { return *this = *this | v; }
+  constexpr int40_t & operator^=(int64_t v) noexcept { return *this = *this ^ v; }
+};
+
+static_assert(sizeof(int40_t) == 5);
+
+} // namespace divss
+
+template <> class std::numeric_limits<divss::int40_t> {
+public:
+  static constexpr bool is_specialized = true;
+  static constexpr bool is_signed = true;
+  static constexpr bool is_integer = true;
+  static constexpr int digits = 39;
+  static constexpr divss::int40_t min() noexcept { return -(int64_t{1} << 39); }
+  static constexpr divss::int40_t max() noexcept { return (int64_t{1} << 39) - 1; }
+  static constexpr divss::int40_t lowest() noexcept { return min(); }
+};
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef LIBDIVSUFSORT_LCP_HPP
+#define LIBDIVSUFSORT_LCP_HPP
+
+#include "common.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <new>
+#include <system_error>
+#include <vector>
+
+#define LCP_PHI_INTERVAL (16)
+#define LCP_PREFETCH (16)
+
+namespace divss::internal {
+
+/*- Private Functions -*/
+
+/* Splits [0, n) into `threads` ranges and calls fn(first, last) for each of
+   them on its own thread. */
+template <typename ResultT, typename Fn> static void lcp_ranges(ResultT n, unsigned threads, Fn && fn) {
+  if((threads <= 1) || (n < static_cast<ResultT>(threads) * INDUCE_BLOCKSIZE)) { fn(ResultT{0}, n); return; }
+  parallel_run(threads, [&](unsigned t) {
+    fn(static_cast<ResultT>(n / threads * t), (t + 1 == threads) ? n : static_cast<ResultT>(n / threads * (t + 1)));
+  });
+}
+
+/* Replaces Phi[first..last-1] by PLCP[first..last-1] for the sampled text
+   positions k * q. Phi[k] is the suffix preceding k * q in the suffix array,
+   or -1 for the smallest suffix. Since PLCP[i + q] >= PLCP[i] - q, the matched
+   length carries over from one sample to the next. */
+template <typename CharT, typename ResultT> static void lcp_plcp(const CharT *T, ResultT *PLCP, ResultT n, ResultT q, ResultT first, ResultT last) noexcept {
+  ResultT i, j, k, h;
+
+  for(k = first, h = 0; k < last; ++k) {
+    if((j = PLCP[k]) < 0) { PLCP[k] = 0, h = 0; continue; }
+    for(i = k * q; (i + h < n) && (j + h < n) && (T[i + h] == T[j + h]); ++h) { }
+    PLCP[k] = h;
+    h = std::max<ResultT>(h - q, 0);
+  }
+}
+
+} // namespace divss::internal
+
+/*---------------------------------------------------------------------------*/
+
+/*- Function -*/
+
+namespace divss {
+
+/* Constructs the LCP array of T[0..n-1] into LCP[0..n-1] from its suffix
+   array SA (as produced by suffix_sort): LCP[i] is the length of the longest
+   common prefix of the suffixes SA[i - 1] and SA[i], and LCP[0] = 0.
+   Uses the sparse Phi algorithm: PLCP is computed for every
+   LCP_PHI_INTERVAL-th text position only, and each LCP[i] is then extended
+   from the bound PLCP[j] >= PLCP[j - r] - r of the preceding sample. The
+   samples take n / LCP_PHI_INTERVAL entries besides T, SA and LCP, so the
+   peak stays near 9n bytes for 32-bit indices. With threads > 1, every pass
+   runs on that many ranges at once. Returns 0 on success, -1 for bad
+   arguments and -2 if it runs out of memory or cannot start its threads. */
+template <typename CharT = unsigned char, typename ResultT = int32_t> int32_t lcp_array(const CharT *T, const ResultT *SA, ResultT *LCP, no_deduce<ResultT> n, unsigned threads = 1) noexcept {
+  constexpr ResultT q = LCP_PHI_INTERVAL;
+
+  /* Check arguments. */
+  if((T == nullptr) || (SA == nullptr) || (LCP == nullptr) || (n < 0)) { return -1; }
+  if(n == 0) { return 0; }
+
+  try {
+    std::vector<ResultT> PLCP((n + q - 1) / q);
+
+    /* Sparse Phi. */
+    internal::lcp_ranges(n, threads, [&](ResultT first, ResultT last) {
+      for(ResultT i = first, j; i < last; ++i) {
+        if(((j = SA[i]) % q) == 0) { PLCP[j / q] = (i == 0) ? ResultT{-1} : SA[i - 1]; }
+      }
+    });
+
+    /* Sparse PLCP, one range of samples per thread. */
+    internal::lcp_ranges(static_cast<ResultT>(PLCP.size()), threads, [&](ResultT first, ResultT last) {
+      internal::lcp_plcp(T, PLCP.data(), n, q, first, last);
+    });
+
+    /* LCP, extending the bound given by the preceding sample. The suffixes
+       LCP_PREFETCH entries ahead are prefetched, as the comparisons of one
+       entry would otherwise serialize their cache misses. */
+    internal::lcp_ranges(n, threads, [&](ResultT first, ResultT last) {
+      for(ResultT i = std::max<ResultT>(first, 1), j, p, h; i < last; ++i) {
+        if(i + 2 * LCP_PREFETCH < last) {
+          __builtin_prefetch(&PLCP[SA[i + 2 * LCP_PREFETCH] / q]);
+          j = SA[i + LCP_PREFETCH], h = std::max<ResultT>(PLCP[j / q] - j % q, 0);
+          __builtin_prefetch(&T[j + h]), __builtin_prefetch(&T[SA[i + LCP_PREFETCH - 1] + h]);
+        }
+        j = SA[i], p = SA[i - 1];
+        for(h = std::max<ResultT>(PLCP[j / q] - j % q, 0); (j + h < n) && (p + h < n) && (T[j + h] == T[p + h]); ++h) { }
+        LCP[i] = h;
+      }
+    });
+  } catch(const std::bad_alloc &) {
+    return -2;
+  } catch(const std::system_error &) {
+    return -2;
+  }
+  LCP[0] = 0;
+  return 0;
+}
+
+} // namespace divss
+
+#endif
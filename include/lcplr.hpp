@@ -0,0 +1,115 @@
+#ifndef LIBDIVSUFSORT_LCPLR_HPP
+#define LIBDIVSUFSORT_LCPLR_HPP
+
+#include "common.hpp"
+#include "lcp.hpp"
+#include <algorithm>
+#include <span>
+#include <vector>
+
+namespace divss {
+
+/*- Class -*/
+
+/* Search structure over a suffix array with the LCP-LR arrays of Manber and
+   Myers. The binary search over SA[0..n-1] visits the midpoints of a fixed
+   tree of intervals (L, R), L = -1 and R = n standing for an empty and an
+   infinite suffix. For each midpoint M, llcp_[M] and rlcp_[M] hold the LCP
+   of SA[M] with SA[L] and with SA[R], so that the search decides most steps
+   without reading the text and never compares a pattern symbol twice: a
+   search takes O(m + log n) symbol comparisons, against O(m log n) in the
+   worst case for sa_search. T and SA are not copied and must outlive the
+   index; the arrays take 2n words. */
+template <typename CharT = unsigned char, typename ResultT = int32_t> class lcp_lr_index {
+  const CharT *T_ = nullptr;
+  const ResultT *SA_ = nullptr;
+  ResultT n_ = 0;
+  std::vector<ResultT> llcp_;   /* LCP of SA[M] and SA[L] */
+  std::vector<ResultT> rlcp_;   /* LCP of SA[M] and SA[R] */
+
+  /* Fills the arrays for the midpoints within (L, R) and returns the LCP of
+     SA[L] and SA[R], 0 when either is a sentinel. */
+  ResultT fill(const ResultT *LCP, int64_t L, int64_t R) noexcept {
+    ResultT a, b;
+    if(R - L <= 1) { return ((0 <= L) && (R < static_cast<int64_t>(n_))) ? LCP[R] : 0; }
+    const int64_t M = L + (R - L) / 2;
+    llcp_[M] = a = fill(LCP, L, M), rlcp_[M] = b = fill(LCP, M, R);
+    return ((0 <= L) && (R < static_cast<int64_t>(n_))) ? std::min(a, b) : 0;
+  }
+
+  /* Index of the first suffix not less than P[0..m-1] (neither less nor
+     starting with it when upper). l and r are the lengths of P matched by
+     SA[L] and SA[R]; a step compares symbols only when the LCP of SA[M] with
+     the side matching more of P is that length, and then from it on. */
+  int64_t bound(const CharT *P, int64_t m, bool upper) const noexcept {
+    int64_t L = -1, R = n_, M, l = 0, r = 0, h, s;
+    while(1 < R - L) {
+      M = L + (R - L) / 2;
+      if(r <= l) {
+        if(l < llcp_[M]) { L = M; continue; }
+        if(llcp_[M] < l) { R = M, r = llcp_[M]; continue; }
+        h = l;
+      } else {
+        if(r < rlcp_[M]) { R = M; continue; }
+        if(rlcp_[M] < r) { L = M, l = rlcp_[M]; continue; }
+        h = r;
+      }
+      for(s = SA_[M]; (h < m) && (s + h < static_cast<int64_t>(n_)) && (T_[s + h] == P[h]); ++h) { }
+      if(h == m) {
+        if(upper) { L = M, l = h; } else { R = M, r = h; }
+      } else if((s + h == static_cast<int64_t>(n_)) || (T_[s + h] < P[h])) {
+        L = M, l = h;
+      } else {
+        R = M, r = h;
+      }
+    }
+    return R;
+  }
+
+public:
+  /* Builds the arrays for the suffix array SA of T[0..n-1] from its LCP
+     array (LCP[i] the LCP of SA[i - 1] and SA[i]), which is computed with
+     lcp_array on `threads` threads when LCP is null. Returns 0 on success
+     and -1 for bad arguments. */
+  int32_t build(const CharT *T, const ResultT *SA, no_deduce<ResultT> n, const ResultT *LCP = nullptr, unsigned threads = 1) {
+    std::vector<ResultT> lcp;
+
+    if((T == nullptr) || (SA == nullptr) || (n < 0)) { return -1; }
+    if((LCP == nullptr) && (0 < n)) {
+      lcp.resize(n);
+      if(lcp_array(T, SA, lcp.data(), n, threads) != 0) { return -1; }
+      LCP = lcp.data();
+    }
+    T_ = T, SA_ = SA, n_ = n;
+    llcp_.assign(n, 0), rlcp_.assign(n, 0);
+    fill(LCP, -1, n);
+    return 0;
+  }
+
+  ResultT size() const noexcept { return n_; }
+
+  /* Searches P[0..m-1] as sa_search does: returns the number of its
+     occurrences, or -1 for bad arguments, and sets *idx, if idx is not null,
+     to the index of the first one in SA (or of where it would be). */
+  ResultT search(const CharT *P, no_deduce<ResultT> m, ResultT *idx = nullptr) const noexcept {
+    if(idx != nullptr) { *idx = -1; }
+    if(((P == nullptr) && (0 < m)) || (m < 0)) { return -1; }
+    if(n_ == 0) { return 0; }
+    const int64_t lo = bound(P, m, false), hi = bound(P, m, true);
+    if(idx != nullptr) { *idx = static_cast<ResultT>(lo); }
+    return static_cast<ResultT>(hi - lo);
+  }
+
+  ResultT count(std::span<const CharT> P) const noexcept {
+    return search(P.data(), static_cast<ResultT>(P.size()));
+  }
+
+  /* Size of the arrays in bytes, T and SA not included. */
+  std::size_t size_in_bytes() const noexcept {
+    return (llcp_.size() + rlcp_.size()) * sizeof(ResultT);
+  }
+};
+
+} // namespace divss
+
+#endif
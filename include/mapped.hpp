@@ -0,0 +1,83 @@
+#ifndef LIBDIVSUFSORT_MAPPED_HPP
+#define LIBDIVSUFSORT_MAPPED_HPP
+
+#include "divsufsort.hpp"
+#include <cerrno>
+#include <limits>
+#include <new>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace divss {
+
+/*- Function -*/
+
+/* Constructs the suffix array of the file in_fd into the file out_fd: the
+   text is mapped read-only, out_fd is sized to n ResultT values, allocated
+   and mapped shared, and suffix_sort writes into it directly. Texts longer
+   than COMPACT_N_MAX are sorted on the mapping itself; shorter ones may be
+   sorted on an n-byte compacted copy (see suffix_sort). The whole text is
+   read ahead up front and the output, written in no particular order, is
+   advised random. out_fd must be open for reading and writing. Returns the
+   text length on success, -1 for bad arguments or a text too long for
+   ResultT and -2 if a file cannot be sized, allocated or mapped or if the
+   sort runs out of memory or threads, errno telling which. */
+template <typename ResultT = int32_t> int64_t suffix_sort_mapped(int in_fd, int out_fd, unsigned threads = 1) noexcept {
+  struct stat st;
+  int64_t n, result;
+  void *T, *SA;
+  int err = 0;
+
+  /* Check arguments. */
+  if((in_fd < 0) || (out_fd < 0) || (::fstat(in_fd, &st) != 0)) { return -1; }
+  if(((n = st.st_size) < 0) || (static_cast<int64_t>(std::numeric_limits<ResultT>::max()) < n)) { return -1; }
+  if(::ftruncate(out_fd, static_cast<off_t>(n * static_cast<int64_t>(sizeof(ResultT)))) != 0) { return -2; }
+  if(n == 0) { return 0; }
+  /* Allocate the blocks now: a full disk would otherwise surface as SIGBUS
+     on a store through the mapping. */
+  if((err = ::posix_fallocate(out_fd, 0, static_cast<off_t>(n * static_cast<int64_t>(sizeof(ResultT))))) != 0) { errno = err; return -2; }
+
+  const std::size_t tsize = static_cast<std::size_t>(n), sasize = tsize * sizeof(ResultT);
+  if((T = ::mmap(nullptr, tsize, PROT_READ, MAP_PRIVATE, in_fd, 0)) == MAP_FAILED) { return -2; }
+  if((SA = ::mmap(nullptr, sasize, PROT_READ | PROT_WRITE, MAP_SHARED, out_fd, 0)) == MAP_FAILED) {
+    ::munmap(T, tsize);
+    return -2;
+  }
+
+  ::madvise(T, tsize, MADV_WILLNEED);
+  ::madvise(SA, sasize, MADV_RANDOM);
+  try {
+    suffix_sort(static_cast<const unsigned char *>(T), static_cast<ResultT *>(SA), static_cast<ResultT>(n), threads);
+    result = n;
+  } catch(const std::bad_alloc &) {
+    result = -2, err = ENOMEM;
+  } catch(const std::system_error & e) {
+    result = -2, err = e.code().value();
+  }
+
+  ::munmap(SA, sasize);
+  ::munmap(T, tsize);
+  if(err != 0) { errno = err; }
+  return result;
+}
+
+/* Same as above, opening input_path and creating output_path. */
+template <typename ResultT = int32_t> int64_t suffix_sort_mapped(const char *input_path, const char *output_path, unsigned threads = 1) noexcept {
+  int in_fd, out_fd;
+  int64_t n;
+
+  if((input_path == nullptr) || (output_path == nullptr)) { return -1; }
+  if((in_fd = ::open(input_path, O_RDONLY)) < 0) { return -1; }
+  if((out_fd = ::open(output_path, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0) { ::close(in_fd); return -1; }
+  n = suffix_sort_mapped<ResultT>(in_fd, out_fd, threads);
+  ::close(out_fd);
+  ::close(in_fd);
+  return n;
+}
+
+} // namespace divss
+
+#endif
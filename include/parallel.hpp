@@ -0,0 +1,55 @@
+#ifndef LIBDIVSUFSORT_PARALLEL_HPP
+#define LIBDIVSUFSORT_PARALLEL_HPP
+
+#include <atomic>
+#include <barrier>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace divss::internal {
+
+/* Runs fn(thread_id) on `threads` threads, the calling thread being thread 0.
+   fn runs only once all the threads are started, as it may wait for all of
+   them; if one cannot be started, the others leave without running it and
+   the std::system_error is rethrown. */
+template <typename Fn> static void parallel_run(unsigned threads, Fn && fn) {
+  std::vector<std::thread> workers;
+  std::atomic<int> state{0}; /* 0 while starting, 1 to run fn, -1 to leave */
+
+  if(threads < 1) { threads = 1; }
+  workers.reserve(threads - 1);
+  try {
+    for(unsigned t = 1; t < threads; ++t) {
+      workers.emplace_back([&fn, &state, t]() {
+        state.wait(0);
+        if(state.load() == 1) { fn(t); }
+      });
+    }
+  } catch(...) {
+    state.store(-1), state.notify_all();
+    for(auto & w: workers) { w.join(); }
+    throw;
+  }
+  state.store(1), state.notify_all();
+  fn(0u);
+  for(auto & w: workers) { w.join(); }
+}
+
+/* Hands out the indices [0, count) through an atomic cursor and calls
+   fn(index, thread_id) for each of them. Returns after all of them are done. */
+template <typename Fn> static void parallel_for(unsigned threads, std::size_t count, Fn && fn) {
+  std::atomic<std::size_t> cursor{0};
+
+  if(count == 0) { return; }
+  if(count < threads) { threads = static_cast<unsigned>(count); }
+  parallel_run(threads, [&](unsigned tid) {
+    for(std::size_t i; (i = cursor.fetch_add(1, std::memory_order_relaxed)) < count;) {
+      fn(i, tid);
+    }
+  });
+}
+
+} // namespace divss::internal
+
+#endif
@@ -0,0 +1,345 @@
+#ifndef LIBDIVSUFSORT_RINDEX_HPP
+#define LIBDIVSUFSORT_RINDEX_HPP
+
+#include "fmindex.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <span>
+#include <vector>
+
+namespace divss {
+
+/*- Class -*/
+
+/* Run-length compressed FM-index (r-index) of a byte text, built from its
+   Burrows-Wheeler transform as produced by divbwt. Everything is stored per
+   run of the transform, so the index takes O(r) words for r runs whatever
+   the text length; on highly repetitive collections r is a small fraction of
+   n. Rows are those of the transform with the sentinel, which is a run of
+   its own (code 0).
+   - count: backward search, each rank being a binary search for the run of
+     the row and one for the runs of the symbol before it, O(m log r).
+   - locate: the search also keeps the suffix array entry of the last row of
+     the range (the toehold), using the entries sampled at the ends of the
+     runs; the other entries follow from Phi(p) = SA[ISA[p] - 1], which is
+     Phi(x) - (x - p) for the nearest x >= p among the positions preceding
+     the suffixes that start a run. Each occurrence costs O(log r). */
+template <typename CharT = unsigned char, typename ResultT = int32_t> class r_index {
+  static_assert(!large_alphabet<CharT>, "r_index handles byte alphabets");
+
+  ResultT n_ = 0;
+  int32_t sigma_ = 0;
+  std::array<int32_t, 256> code_{};
+  std::vector<ResultT> C_;         /* first row of each code */
+  std::vector<ResultT> starts_;    /* first row of each run, then n + 1 */
+  std::vector<uint16_t> heads_;    /* code of each run */
+  std::vector<ResultT> offset_;    /* runs of code c: runs_[offset_[c]..offset_[c + 1]) */
+  std::vector<ResultT> runs_;      /* runs of each code, in row order */
+  std::vector<ResultT> cum_;       /* rows of code c in the runs of c before runs_[i] */
+  std::vector<ResultT> end_sa_;    /* suffix array entry of the last row of each run */
+  std::vector<ResultT> phi_pos_;   /* sorted x = SA[s] - 1, s the first row of a run */
+  std::vector<ResultT> phi_val_;   /* Phi(x) */
+
+  /* Run containing row i. */
+  int64_t run_of(int64_t i) const noexcept {
+    return static_cast<int64_t>(std::upper_bound(starts_.begin(), starts_.end(), static_cast<ResultT>(i)) - starts_.begin()) - 1;
+  }
+
+  /* Number of runs of c before run k. */
+  int64_t runs_before(int32_t c, int64_t k) const noexcept {
+    return static_cast<int64_t>(std::lower_bound(runs_.begin() + offset_[c], runs_.begin() + offset_[c + 1], static_cast<ResultT>(k)) -
+                                (runs_.begin() + offset_[c]));
+  }
+
+  /* Occurrences of c in the rows [0, i) of the transform. */
+  int64_t rank(int32_t c, int64_t i) const noexcept {
+    if(static_cast<int64_t>(n_) < i) { return C_[c + 1] - C_[c]; }
+    const int64_t k = run_of(i), j = runs_before(c, k);
+    const int64_t h = (j < (offset_[c + 1] - offset_[c])) ? static_cast<int64_t>(cum_[offset_[c] + j]) : static_cast<int64_t>(C_[c + 1] - C_[c]);
+    return h + ((heads_[k] == c) ? i - starts_[k] : 0);
+  }
+
+  int64_t phi(int64_t p) const noexcept {
+    const auto it = std::lower_bound(phi_pos_.begin(), phi_pos_.end(), static_cast<ResultT>(p));
+    if(it == phi_pos_.end()) { return -1; } /* past the last sample, only on a corrupt index */
+    return static_cast<int64_t>(phi_val_[it - phi_pos_.begin()]) - (static_cast<int64_t>(*it) - p);
+  }
+
+  /* Backward search with the toehold: sets [sp, ep) to the rows prefixed by
+     P[0..m-1] and toe to the suffix array entry of row ep - 1. */
+  void range(const CharT *P, ResultT m, int64_t & sp, int64_t & ep, int64_t & toe) const noexcept {
+    int64_t i, k, j;
+    int32_t c;
+    sp = (0 < m) ? 0 : 1, ep = static_cast<int64_t>(n_) + 1, toe = end_sa_.back();
+    for(i = m; (0 < i) && (sp < ep); --i) {
+      if((c = code_[static_cast<unsigned char>(P[i - 1])]) < 0) { sp = ep = 0; return; }
+      k = run_of(ep - 1);
+      if(heads_[k] == c) { toe -= 1; }
+      else if(0 < (j = runs_before(c, k))) { toe = end_sa_[runs_[offset_[c] + j - 1]] - 1; }
+      sp = C_[c] + rank(c, sp), ep = C_[c] + rank(c, ep);
+    }
+  }
+
+  /* Builds the runs of the transform with the sentinel at row pidx. */
+  void build_runs(const CharT *U, int64_t n, int64_t pidx) {
+    std::array<int64_t, 256> count{};
+    int64_t i, k;
+    int32_t c, prev;
+
+    for(i = 0; i < n; ++i) { ++count[static_cast<unsigned char>(U[i])]; }
+    for(c = 0, sigma_ = 1; c < 256; ++c) { code_[c] = (0 < count[c]) ? sigma_++ : -1; }
+    C_.assign(sigma_ + 1, 0);
+    for(c = 0, i = 1; c < 256; ++c) {
+      if(0 <= code_[c]) { C_[code_[c]] = static_cast<ResultT>(i), i += count[c]; }
+    }
+    C_[sigma_] = static_cast<ResultT>(i);
+
+    starts_.clear(), heads_.clear();
+    for(i = 0, prev = -1; i <= n; ++i) {
+      c = (i == pidx) ? 0 : code_[static_cast<unsigned char>(U[i - (pidx < i)])];
+      if((c != prev) || (c == 0)) { starts_.push_back(static_cast<ResultT>(i)), heads_.push_back(static_cast<uint16_t>(c)); }
+      prev = c;
+    }
+    starts_.push_back(static_cast<ResultT>(n + 1));
+
+    /* Runs of each code and the rows they cover before each of them. */
+    const int64_t r = static_cast<int64_t>(heads_.size());
+    std::vector<int64_t> seen(sigma_, 0), rows(sigma_, 0);
+    offset_.assign(sigma_ + 1, 0);
+    for(k = 0; k < r; ++k) { ++offset_[heads_[k] + 1]; }
+    for(c = 0; c < sigma_; ++c) { offset_[c + 1] += offset_[c]; }
+    runs_.assign(r, 0), cum_.assign(r, 0);
+    for(k = 0; k < r; ++k) {
+      c = heads_[k];
+      runs_[offset_[c] + seen[c]] = static_cast<ResultT>(k);
+      cum_[offset_[c] + seen[c]++] = static_cast<ResultT>(rows[c]);
+      rows[c] += starts_[k + 1] - starts_[k];
+    }
+  }
+
+  /* Builds end_sa_ and the Phi samples from the suffix array entries of the
+     first and last row of each run, and of the last row before each code. */
+  void build_samples(const std::vector<ResultT> & start_sa, const std::vector<ResultT> & bound_sa) {
+    const int64_t r = static_cast<int64_t>(heads_.size());
+    std::vector<std::pair<ResultT, ResultT>> phi;
+    int64_t k, j;
+    int32_t c;
+
+    phi.reserve(r);
+    for(k = 0; k < r; ++k) {
+      if((c = heads_[k]) == 0) { continue; }
+      j = runs_before(c, k);
+      phi.emplace_back(static_cast<ResultT>(start_sa[k] - 1), (0 < j) ? static_cast<ResultT>(end_sa_[runs_[offset_[c] + j - 1]] - 1) : bound_sa[c]);
+    }
+    std::sort(phi.begin(), phi.end());
+    phi_pos_.resize(phi.size()), phi_val_.resize(phi.size());
+    for(std::size_t i = 0; i < phi.size(); ++i) { phi_pos_[i] = phi[i].first, phi_val_[i] = phi[i].second; }
+  }
+
+  /* Reads what save writes after the magic and checks it: the header, the
+     size of every part against it and the number of runs, the runs of each
+     code and the rows before them against starts_ and heads_, and C
+     against the rows of each code. */
+  bool read(std::FILE *fp) {
+    int64_t header[2], k, r;
+    int32_t c;
+    if(!internal::fm_read(fp, header, 2)) { return false; }
+    if((header[0] < 0) || (static_cast<int64_t>(std::numeric_limits<ResultT>::max()) <= header[0]) || (header[1] < 1) || (257 < header[1])) { return false; }
+    n_ = static_cast<ResultT>(header[0]), sigma_ = static_cast<int32_t>(header[1]);
+
+    const uint64_t n = static_cast<uint64_t>(n_), sigma = static_cast<uint64_t>(sigma_);
+    if(!internal::fm_read(fp, code_.data(), code_.size()) ||
+       !internal::fm_read_vector(fp, C_, sigma + 1) || (C_.size() != sigma + 1) ||
+       !internal::fm_read_vector(fp, starts_, n + 2) || (starts_.size() < 2)) {
+      return false;
+    }
+    r = static_cast<int64_t>(starts_.size()) - 1;
+    if(!internal::fm_read_vector(fp, heads_, r) || (heads_.size() != static_cast<std::size_t>(r)) ||
+       !internal::fm_read_vector(fp, offset_, sigma + 1) || (offset_.size() != sigma + 1) ||
+       !internal::fm_read_vector(fp, runs_, r) || (runs_.size() != static_cast<std::size_t>(r)) ||
+       !internal::fm_read_vector(fp, cum_, r) || (cum_.size() != static_cast<std::size_t>(r)) ||
+       !internal::fm_read_vector(fp, end_sa_, r) || (end_sa_.size() != static_cast<std::size_t>(r)) ||
+       !internal::fm_read_vector(fp, phi_pos_, r) || !internal::fm_read_vector(fp, phi_val_, r) || (phi_val_.size() != phi_pos_.size())) {
+      return false;
+    }
+
+    if(std::any_of(code_.begin(), code_.end(), [this](int32_t x) { return (x != -1) && ((x < 1) || (sigma_ <= x)); })) { return false; }
+    if((starts_[0] != 0) || (starts_[r] != n_ + 1)) { return false; }
+    for(k = 0; k < r; ++k) {
+      if((starts_[k + 1] <= starts_[k]) || (sigma_ <= heads_[k]) || (end_sa_[k] < 0) || (n_ < end_sa_[k])) { return false; }
+    }
+    if((offset_[0] != 0) || (offset_[sigma] != r)) { return false; }
+    for(c = 0; c < sigma_; ++c) {
+      if(offset_[c + 1] < offset_[c]) { return false; }
+    }
+    std::vector<int64_t> seen(sigma, 0), rows(sigma, 0);
+    for(k = 0; k < r; ++k) {
+      c = heads_[k];
+      const int64_t j = offset_[c] + seen[c]++;
+      if((offset_[c + 1] <= j) || (runs_[j] != k) || (cum_[j] != rows[c])) { return false; }
+      rows[c] += starts_[k + 1] - starts_[k];
+    }
+    if(C_[0] != 0) { return false; }
+    for(c = 0; c < sigma_; ++c) {
+      if(C_[c + 1] - C_[c] != rows[c]) { return false; }
+    }
+    return true;
+  }
+
+public:
+  /* Builds the index of T[0..n-1], sorting its suffixes with `threads`
+     threads. Returns 0 on success and -1 for bad arguments. */
+  int32_t build(const CharT *T, no_deduce<ResultT> n, unsigned threads = 1) {
+    if((T == nullptr) || (n < 0) || (n == std::numeric_limits<ResultT>::max())) { return -1; }
+
+    std::vector<ResultT> SA(n + 1);
+    std::vector<CharT> U(n);
+    int64_t i, j, pidx = 0;
+
+    /* SA[i] becomes the entry of row i, row 0 being the suffix n. */
+    if(0 < n) { suffix_sort(T, SA.data() + 1, n, threads); }
+    SA[0] = n;
+    if(0 < n) { U[0] = T[n - 1]; }
+    for(i = 1, j = 1; i <= n; ++i) {
+      if(SA[i] == 0) { pidx = i; } else { U[j++] = T[SA[i] - 1]; }
+    }
+    n_ = n;
+    build_runs(U.data(), n, pidx);
+    U = std::vector<CharT>();
+
+    const int64_t r = static_cast<int64_t>(heads_.size());
+    std::vector<ResultT> start_sa(r), bound_sa(sigma_, 0);
+    end_sa_.resize(r);
+    for(i = 0; i < r; ++i) { start_sa[i] = SA[starts_[i]], end_sa_[i] = SA[starts_[i + 1] - 1]; }
+    for(int32_t c = 1; c < sigma_; ++c) { bound_sa[c] = SA[C_[c] - 1]; }
+    build_samples(start_sa, bound_sa);
+    return 0;
+  }
+
+  /* Builds the index from the output U[0..n-1] and pidx of divbwt. The
+     samples are taken in one backward walk over the text through LF, which
+     takes O(n) time and n bits besides U and the index to mark the runs. Returns 0 on success and
+     -1 for bad arguments. */
+  int32_t build_from_bwt(const CharT *U, no_deduce<ResultT> n, no_deduce<ResultT> pidx) {
+    if((U == nullptr) || (n < 0) || (n == std::numeric_limits<ResultT>::max()) ||
+       (pidx < 0) || (n < pidx) || ((0 < n) && (pidx == 0))) {
+      return -1;
+    }
+
+    n_ = n;
+    build_runs(U, n, pidx);
+
+    const int64_t r = static_cast<int64_t>(heads_.size());
+    std::vector<ResultT> start_sa(r), bound_sa(sigma_, 0);
+    std::vector<std::array<int64_t, 2>> lf(r);
+    std::vector<int64_t> seen(sigma_, 0);
+    internal::fm_bitvector heads;
+    int64_t j, i, k;
+    int32_t c;
+
+    /* First rows of the runs and n + 1, so that the run of a row is one rank. */
+    heads.resize(static_cast<uint64_t>(n) + 2);
+    for(k = 0; k <= r; ++k) { heads.set(starts_[k]); }
+    heads.finish();
+
+    /* LF of the first row of each run and its first row, side by side. */
+    for(k = 0; k < r; ++k) {
+      c = heads_[k];
+      lf[k] = {C_[c] + static_cast<int64_t>(cum_[offset_[c] + seen[c]++]), starts_[k]};
+    }
+    end_sa_.resize(r);
+    start_sa[0] = n, end_sa_[0] = n, bound_sa[1 % sigma_] = n;
+    for(j = static_cast<int64_t>(n) - 1, i = 0, k = 0; 0 <= j; --j) {
+      i = lf[k][0] + (i - lf[k][1]);
+      k = static_cast<int64_t>(heads.rank1(i + 1)) - 1;
+      if(i == lf[k][1]) { start_sa[k] = static_cast<ResultT>(j); }
+      if(heads.get(i + 1)) { end_sa_[k] = static_cast<ResultT>(j); }
+      c = static_cast<int32_t>(std::lower_bound(C_.begin(), C_.end(), static_cast<ResultT>(i + 1)) - C_.begin());
+      if((c < sigma_) && (C_[c] == i + 1)) { bound_sa[c] = static_cast<ResultT>(j); }
+    }
+    build_samples(start_sa, bound_sa);
+    return 0;
+  }
+
+  ResultT size() const noexcept { return n_; }
+
+  /* Number of runs of the transform, the sentinel included. */
+  ResultT runs() const noexcept { return static_cast<ResultT>(heads_.size()); }
+
+  /* Returns the number of occurrences of P[0..m-1] in the text, or -1 for
+     bad arguments. */
+  ResultT count(const CharT *P, no_deduce<ResultT> m) const noexcept {
+    int64_t sp, ep, toe;
+    if(((P == nullptr) && (0 < m)) || (m < 0)) { return -1; }
+    range(P, m, sp, ep, toe);
+    return static_cast<ResultT>(std::max<int64_t>(ep - sp, 0));
+  }
+
+  /* Finds the occurrences of P[0..m-1] and stores the text positions of the
+     last `size` rows of their range, in suffix array order, into occ (all
+     of them when size is at least their number). Returns the number of
+     occurrences, or -1 for bad arguments. */
+  ResultT locate(const CharT *P, no_deduce<ResultT> m, ResultT *occ, no_deduce<ResultT> size) const noexcept {
+    int64_t sp, ep, toe, k;
+    if(((P == nullptr) && (0 < m)) || (m < 0) || ((occ == nullptr) && (0 < size))) { return -1; }
+    range(P, m, sp, ep, toe);
+    if(ep <= sp) { return 0; }
+    for(k = std::min<int64_t>(ep - sp, size) - 1; 0 <= k; --k) {
+      occ[k] = static_cast<ResultT>(toe);
+      if(0 < k) { toe = phi(toe); }
+    }
+    return static_cast<ResultT>(ep - sp);
+  }
+
+  std::vector<ResultT> locate(std::span<const CharT> P) const {
+    std::vector<ResultT> occ(count(P.data(), static_cast<ResultT>(P.size())));
+    locate(P.data(), static_cast<ResultT>(P.size()), occ.data(), static_cast<ResultT>(occ.size()));
+    return occ;
+  }
+
+  /* Size of the index in bytes. */
+  std::size_t size_in_bytes() const noexcept {
+    return sizeof(*this) + heads_.size() * sizeof(uint16_t) +
+           (C_.size() + starts_.size() + offset_.size() + runs_.size() + cum_.size() + end_sa_.size() + phi_pos_.size() + phi_val_.size()) * sizeof(ResultT);
+  }
+
+  /* Writes the index to fp. Returns 0 on success and -2 on a write error. */
+  int32_t save(std::FILE *fp) const noexcept {
+    const char magic[8] = {'D', 'S', 'S', 'R', 'I', 'X', '1', static_cast<char>(sizeof(ResultT))};
+    const int64_t header[2] = {n_, sigma_};
+    if((fp == nullptr) || !internal::fm_write(fp, magic, 8) || !internal::fm_write(fp, header, 2) ||
+       !internal::fm_write(fp, code_.data(), code_.size()) || !internal::fm_write_vector(fp, C_) ||
+       !internal::fm_write_vector(fp, starts_) || !internal::fm_write_vector(fp, heads_) ||
+       !internal::fm_write_vector(fp, offset_) || !internal::fm_write_vector(fp, runs_) ||
+       !internal::fm_write_vector(fp, cum_) || !internal::fm_write_vector(fp, end_sa_) ||
+       !internal::fm_write_vector(fp, phi_pos_) || !internal::fm_write_vector(fp, phi_val_)) {
+      return -2;
+    }
+    return 0;
+  }
+
+  /* Reads an index written by save. Returns 0 on success, -1 if fp does not
+     hold an index with this ResultT and -2 on a read error, on a corrupt or
+     truncated index and if it does not fit in memory. The index is left
+     unchanged unless it succeeds. */
+  int32_t load(std::FILE *fp) noexcept {
+    const char expected[8] = {'D', 'S', 'S', 'R', 'I', 'X', '1', static_cast<char>(sizeof(ResultT))};
+    char magic[8];
+    if((fp == nullptr) || !internal::fm_read(fp, magic, 8)) { return -2; }
+    if(!std::equal(magic, magic + 8, expected)) { return -1; }
+    try {
+      r_index index;
+      if(!index.read(fp)) { return -2; }
+      *this = std::move(index);
+    } catch(const std::bad_alloc &) {
+      return -2;
+    } catch(const std::length_error &) {
+      return -2;
+    }
+    return 0;
+  }
+};
+
+} // namespace divss
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef LIBDIVSUFSORT_SAIS_HPP
+#define LIBDIVSUFSORT_SAIS_HPP
+
+#include "common.hpp"
+#include <algorithm>
+#include <vector>
+
+namespace divss::internal {
+
+/*- Private Functions -*/
+
+/* Induced sorting (SA-IS) for large alphabets. T[0..n-1] holds symbols of
+   the dense range [0, k) and is followed by a virtual sentinel which is
+   smaller than every symbol. All tables are O(k), so the memory use stays
+   O(n + k) however large the alphabet is.
+
+   When ends is given, T is a concatenation of documents and ends[i] is set
+   for the last position of each one. Every document is then followed by its
+   own virtual sentinel, the sentinels being ordered by position and smaller
+   than every symbol, so no suffix is compared across a document end. */
+
+template <typename CharT, typename ResultT> static void sais_buckets(const CharT *T, ResultT *C, ResultT n, ResultT k) noexcept {
+  std::fill(C, C + k, ResultT{0});
+  for(ResultT i = 0; i < n; ++i) { ++C[static_cast<ResultT>(T[i])]; }
+}
+
+template <typename ResultT> static void sais_bucket_bounds(const ResultT *C, ResultT *B, ResultT k, bool end) noexcept {
+  ResultT i, sum = 0;
+  if(end) { for(i = 0; i < k; ++i) { sum += C[i]; B[i] = sum; } }
+  else { for(i = 0; i < k; ++i) { sum += C[i]; B[i] = sum - C[i]; } }
+}
+
+/* Induces the type L suffixes from the sorted LMS suffixes, then the type S
+   suffixes from the type L ones. */
+template <typename CharT, typename ResultT> static void sais_induce(const CharT *T, ResultT *SA, const std::vector<bool> & typeS, const std::vector<bool> *ends, const ResultT *C, ResultT *B, ResultT n, ResultT k) noexcept {
+  ResultT i, j;
+
+  /* type L suffixes; the sentinels induce the last suffix of each document
+     first, in document order. */
+  sais_bucket_bounds(C, B, k, false);
+  if(ends == nullptr) {
+    SA[B[static_cast<ResultT>(T[n - 1])]++] = n - 1;
+  } else {
+    for(i = 0; i < n; ++i) {
+      if((*ends)[i]) { SA[B[static_cast<ResultT>(T[i])]++] = i; }
+    }
+  }
+  for(i = 0; i < n; ++i) {
+    if((0 < (j = SA[i])) && !typeS[--j] && ((ends == nullptr) || !(*ends)[j])) { SA[B[static_cast<ResultT>(T[j])]++] = j; }
+  }
+
+  /* type S suffixes; the last position of a document is never type S. */
+  sais_bucket_bounds(C, B, k, true);
+  for(i = n - 1; 0 <= i; --i) {
+    if((0 < (j = SA[i])) && typeS[--j]) { SA[--B[static_cast<ResultT>(T[j])]] = j; }
+  }
+}
+
+template <typename CharT, typename ResultT> static void sais_main(const CharT *T, ResultT *SA, ResultT n, ResultT k, const std::vector<bool> *ends = nullptr) {
+  std::vector<bool> typeS(n);
+  std::vector<ResultT> C(k), B(k);
+  ResultT *RA;
+  ResultT i, j, p, q, d, n1, name;
+
+  if(n == 1) { SA[0] = 0; return; }
+
+  /* Classify the suffixes; the last suffix of a document is type L because
+     of its sentinel, and the first one is never LMS. */
+  auto is_end = [&](ResultT x) { return (x == n - 1) || ((ends != nullptr) && (*ends)[x]); };
+  for(i = n - 2; 0 <= i; --i) {
+    typeS[i] = !is_end(i) && ((T[i] < T[i + 1]) || ((T[i] == T[i + 1]) && typeS[i + 1]));
+  }
+  auto is_lms = [&](ResultT x) { return (0 < x) && typeS[x] && !typeS[x - 1] && !is_end(x - 1); };
+
+  /* Sort the LMS substrings. */
+  sais_buckets(T, C.data(), n, k);
+  sais_bucket_bounds(C.data(), B.data(), k, true);
+  std::fill(SA, SA + n, ResultT{-1});
+  for(i = 1; i < n; ++i) {
+    if(is_lms(i)) { SA[--B[static_cast<ResultT>(T[i])]] = i; }
+  }
+  sais_induce(T, SA, typeS, ends, C.data(), B.data(), n, k);
+
+  /* Compact the sorted LMS substrings into SA[0..n1-1]. */
+  for(i = 0, n1 = 0; i < n; ++i) {
+    if(is_lms(SA[i])) { SA[n1++] = SA[i]; }
+  }
+
+  /* Name the LMS substrings; SA[n1 + p / 2] keeps the name of position p. */
+  std::fill(SA + n1, SA + n, ResultT{-1});
+  for(i = 0, name = 0, q = -1; i < n1; ++i) {
+    p = SA[i];
+    bool diff = (q < 0);
+    for(d = 0; !diff; ++d) {
+      if(((0 < d) && (is_end(p + d - 1) || is_end(q + d - 1))) || (T[p + d] != T[q + d]) || (typeS[p + d] != typeS[q + d])) { diff = true; }
+      else if((0 < d) && (is_lms(p + d) || is_lms(q + d))) { break; }
+    }
+    if(diff) { ++name, q = p; }
+    SA[n1 + p / 2] = name - 1;
+  }
+  for(i = n - 1, j = n - 1; n1 <= i; --i) {
+    if(0 <= SA[i]) { SA[j--] = SA[i]; }
+  }
+
+  /* Sort the reduced string RA, recursing while names are not unique. */
+  RA = SA + n - n1;
+  if(name < n1) {
+    sais_main<ResultT, ResultT>(RA, SA, n1, name);
+  } else {
+    for(i = 0; i < n1; ++i) { SA[RA[i]] = i; }
+  }
+
+  /* Map the reduced suffixes back to LMS positions. */
+  for(i = n - 1, j = n1 - 1; 0 < i; --i) {
+    if(is_lms(i)) { RA[j--] = i; }
+  }
+  for(i = 0; i < n1; ++i) { SA[i] = RA[SA[i]]; }
+  std::fill(SA + n1, SA + n, ResultT{-1});
+
+  /* Put the sorted LMS suffixes at the ends of their buckets and induce. */
+  sais_bucket_bounds(C.data(), B.data(), k, true);
+  for(i = n1 - 1; 0 <= i; --i) {
+    j = SA[i], SA[i] = -1;
+    SA[--B[static_cast<ResultT>(T[j])]] = j;
+  }
+  sais_induce(T, SA, typeS, ends, C.data(), B.data(), n, k);
+}
+
+} // namespace divss::internal
+
+#endif
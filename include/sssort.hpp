@@ -24,7 +24,18 @@
  * OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#ifndef LIBDIVSUFSORT_SSSORT_HPP
+#define LIBDIVSUFSORT_SSSORT_HPP
+
 #include "common.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 /*- Private Functions -*/
 
@@ -34,7 +45,7 @@ namespace divss::internal {
 
 template <typename ResultT> static inline int32_t ss_ilg(ResultT n) noexcept {
 #if SS_BLOCKSIZE == 0
-	if constexpr (sizeof(ResultT) == 8) {
+	if constexpr (4 < sizeof(ResultT)) {
   return (n >> 32) ?
           ((n >> 48) ?
             ((n >> 56) ?
@@ -102,16 +113,53 @@ static inline int ss_isqrt(int x) noexcept {
 
 /*---------------------------------------------------------------------------*/
 
+/* Returns the length of the common prefix of U1[0..len-1] and U2[0..len-1].
+   Byte strings are compared 32 bytes (AVX2), 16 bytes (SSE2) or 8 bytes at a
+   time; all loads stay within the len bytes. */
+template <typename CharT = unsigned char> static inline std::ptrdiff_t ss_mismatch(const CharT *U1, const CharT *U2, std::ptrdiff_t len) noexcept {
+  std::ptrdiff_t k = 0;
+
+  if constexpr((sizeof(CharT) == 1) && std::is_unsigned_v<CharT>) {
+#if defined(__AVX2__)
+    for(; k + 32 <= len; k += 32) {
+      uint32_t m = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(U1 + k)),
+                                                                                _mm256_loadu_si256(reinterpret_cast<const __m256i *>(U2 + k)))));
+      if(m != 0xffffffffu) { return k + std::countr_one(m); }
+    }
+#endif
+#if defined(__SSE2__)
+    for(; k + 16 <= len; k += 16) {
+      uint32_t m = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(U1 + k)),
+                                                                          _mm_loadu_si128(reinterpret_cast<const __m128i *>(U2 + k)))));
+      if(m != 0xffffu) { return k + std::countr_one(m); }
+    }
+#endif
+    if constexpr(std::endian::native == std::endian::little) {
+      for(; k + 8 <= len; k += 8) {
+        uint64_t a, b;
+        std::memcpy(&a, U1 + k, 8), std::memcpy(&b, U2 + k, 8);
+        if(a != b) { return k + (std::countr_zero(a ^ b) >> 3); }
+      }
+    }
+  }
+  for(; (k < len) && (U1[k] == U2[k]); ++k) { }
+  return k;
+}
+
 /* Compares two suffixes. */
 template <typename CharT = unsigned char, typename ResultT = int> static inline int32_t ss_compare(const CharT *T, const ResultT *p1, const ResultT *p2, int depth) {
   const CharT *U1, *U2, *U1n, *U2n;
 
-  for(U1 = T + depth + *p1,
-      U2 = T + depth + *p2,
-      U1n = T + *(p1 + 1) + 2,
-      U2n = T + *(p2 + 1) + 2;
-      (U1 < U1n) && (U2 < U2n) && (*U1 == *U2);
-      ++U1, ++U2) {
+  U1 = T + depth + *p1,
+  U2 = T + depth + *p2,
+  U1n = T + *(p1 + 1) + 2,
+  U2n = T + *(p2 + 1) + 2;
+  /* most comparisons end within a few symbols; test those before the
+     word-at-a-time kernel, which pays off on long common prefixes */
+  for(int i = 0; (i < 4) && (U1 < U1n) && (U2 < U2n) && (*U1 == *U2); ++i, ++U1, ++U2) { }
+  if((U1 < U1n) && (U2 < U2n) && (*U1 == *U2)) {
+    std::ptrdiff_t k = ss_mismatch(U1, U2, std::min(U1n - U1, U2n - U2));
+    U1 += k, U2 += k;
   }
 
   return U1 < U1n ?
@@ -388,6 +436,168 @@ template <typename CharT = unsigned char, typename ResultT = int> static void ss
   }
 }
 
+/*---------------------------------------------------------------------------*/
+
+/* Returns the next SS_KEY_SYMBOLS symbols of the substring *p from depth on,
+   9 bits each: the symbol plus one, or 0 past the end of the substring, so
+   that keys compare as the substrings do. */
+template <typename CharT = unsigned char, typename ResultT = int> static inline uint64_t ss_key(const CharT *T, const ResultT *p, ResultT depth) noexcept {
+  const CharT *U = T + depth + *p;
+  const std::ptrdiff_t r = (T + *(p + 1) + 2) - U;
+  uint64_t k = 0;
+
+  if(SS_KEY_SYMBOLS <= r) {
+    for(std::ptrdiff_t i = 0; i < SS_KEY_SYMBOLS; ++i) { k = (k << 9) | (static_cast<uint64_t>(U[i]) + 1); }
+  } else {
+    for(std::ptrdiff_t i = 0; i < SS_KEY_SYMBOLS; ++i) { k = (k << 9) | ((i < r) ? static_cast<uint64_t>(U[i]) + 1 : 0); }
+  }
+  return k;
+}
+
+/* Loads the keys of [first, last) at depth into K. */
+template <typename CharT = unsigned char, typename ResultT = int> static inline void ss_loadkeys(const CharT *T, const ResultT *PA, const ResultT *first, const ResultT *last, uint64_t *K, ResultT depth) noexcept {
+  for(; first < last; ++first, ++K) {
+    if(SS_KEY_PREFETCH < (last - first)) {
+      __builtin_prefetch(&T[PA[*(first + SS_KEY_PREFETCH)] + depth]);
+      if((2 * SS_KEY_PREFETCH) < (last - first)) { __builtin_prefetch(&PA[*(first + 2 * SS_KEY_PREFETCH)]); }
+    }
+    *K = ss_key(T, PA + *first, depth);
+  }
+}
+
+/* Multikey introsort on cached keys, used instead of ss_mintrosort when
+   SS_CACHED_KEYS is set. K[i] holds the key of first[i] and moves with it,
+   so a partition compares SS_KEY_SYMBOLS symbols at once and reads K
+   sequentially instead of T through PA; the keys of a group are reloaded
+   from T only once its depth passes them. A key splits a group into many
+   more parts than a symbol does, hence twice the usual depth limit; groups
+   split too unevenly even so are left to ss_mintrosort. */
+template <typename CharT = unsigned char, typename ResultT = int> static void ss_mintrosort_cached(const CharT *T, const ResultT *PA, ResultT *first, ResultT *last, uint64_t *K, ResultT depth) {
+  struct stack_type {
+    ResultT *a;
+    ResultT *b;
+    ResultT c;
+    int32_t d;
+    constexpr operator auto() noexcept {
+      return std::tie(a,b,c,d);
+    }
+  };
+
+  static_stack<stack_type, min_stack_size<ResultT>()> stack;
+  stack_type parts[3];
+  ResultT *const base = first;
+  ResultT *a, *b, *c, *d, *e, *f;
+  ResultT t;
+  uint64_t u, v, w;
+  int32_t limit, i, j;
+
+  if((last - first) <= SS_INSERTIONSORT_THRESHOLD) {
+    if constexpr (1 < SS_INSERTIONSORT_THRESHOLD) {
+      if(1 < (last - first)) { ss_insertionsort(T, PA, first, last, depth); }
+    }
+    return;
+  }
+
+  ss_loadkeys(T, PA, first, last, K, depth);
+  for(limit = 2 * ss_ilg(last - first);;) {
+
+    if((last - first) <= SS_INSERTIONSORT_THRESHOLD) {
+      for(a = first + 1; a < last; ++a) {
+        for(t = *a, v = K[a - base], b = a; (first < b) && (v < K[b - 1 - base]); --b) {
+          *b = *(b - 1), K[b - base] = K[b - 1 - base];
+        }
+        *b = t, K[b - base] = v;
+      }
+      for(a = first; a < last; a = b) {
+        for(b = a + 1; (b < last) && (K[b - base] == K[a - base]); ++b) { }
+        if(1 < (b - a)) {
+          if((K[a - base] & 0x1ff) == 0) {
+            for(c = a + 1; c < b; ++c) { *c = ~*c; }
+          } else if constexpr (1 < SS_INSERTIONSORT_THRESHOLD) {
+            ss_insertionsort(T, PA, a, b, static_cast<ResultT>(depth + SS_KEY_SYMBOLS));
+          }
+        }
+      }
+      if (stack.size() == 0) return;
+      stack.pop_into(first, last, depth, limit);
+      continue;
+    }
+
+    if(limit-- == 0) {
+      /* ss_mintrosort needs a symbol left in each substring; those ended
+         (key 0) come first and are equal */
+      for(a = c = first; c < last; ++c) {
+        if(K[c - base] == 0) { std::swap(*a, *c), std::swap(K[a - base], K[c - base]), ++a; }
+      }
+      for(c = first + 1; c < a; ++c) { *c = ~*c; }
+      if(1 < (last - a)) { ss_mintrosort(T, PA, a, last, depth); }
+      if (stack.size() == 0) return;
+      stack.pop_into(first, last, depth, limit);
+      continue;
+    }
+
+    /* choose pivot */
+    u = K[first - base], v = K[(first - base) + (last - first) / 2], w = K[(last - 1) - base];
+    if(u > v) { std::swap(u, v); }
+    if(v > w) { v = (u > w) ? u : w; }
+
+    /* partition, with the equal keys gathered at both ends and then moved
+       between: [first, a) < v, [a, b) == v and [b, last) > v */
+    for(a = b = first, c = d = last - 1;;) {
+      for(; (b <= c) && ((u = K[b - base]) <= v); ++b) {
+        if(u == v) { std::swap(*a, *b), std::swap(K[a - base], K[b - base]), ++a; }
+      }
+      for(; (b <= c) && ((u = K[c - base]) >= v); --c) {
+        if(u == v) { std::swap(*c, *d), std::swap(K[c - base], K[d - base]), --d; }
+      }
+      if(c < b) { break; }
+      std::swap(*b, *c), std::swap(K[b - base], K[c - base]), ++b, --c;
+    }
+    for(e = first, f = b - std::min(a - first, b - a); f < b; ++e, ++f) {
+      std::swap(*e, *f), std::swap(K[e - base], K[f - base]);
+    }
+    for(e = b, f = last - std::min(d - c, last - 1 - d); f < last; ++e, ++f) {
+      std::swap(*e, *f), std::swap(K[e - base], K[f - base]);
+    }
+    a = first + (b - a), b = last - (d - c);
+
+    /* equal keys ending within the key are equal substrings */
+    i = 0;
+    if((v & 0x1ff) == 0) {
+      for(c = a + 1; c < b; ++c) { *c = ~*c; }
+    } else if(1 < (b - a)) {
+      ss_loadkeys(T, PA, a, b, K + (a - base), static_cast<ResultT>(depth + SS_KEY_SYMBOLS));
+      parts[i++] = {a, b, static_cast<ResultT>(depth + SS_KEY_SYMBOLS), 2 * ss_ilg(b - a)};
+    }
+    if(1 < (a - first)) { parts[i++] = {first, a, depth, limit}; }
+    if(1 < (last - b)) { parts[i++] = {b, last, depth, limit}; }
+
+    /* continue with the smallest part */
+    for(j = 1; j < i; ++j) {
+      for(int32_t k = j; (0 < k) && ((parts[k - 1].b - parts[k - 1].a) < (parts[k].b - parts[k].a)); --k) {
+        std::swap(parts[k - 1], parts[k]);
+      }
+    }
+    if(i == 0) {
+      if (stack.size() == 0) return;
+      stack.pop_into(first, last, depth, limit);
+      continue;
+    }
+    for(j = 0; j < (i - 1); ++j) { stack.push(parts[j].a, parts[j].b, parts[j].c, parts[j].d); }
+    first = parts[i - 1].a, last = parts[i - 1].b, depth = parts[i - 1].c, limit = parts[i - 1].d;
+  }
+}
+
+/* Sorts a block with ss_mintrosort_cached when K is not null, with
+   ss_mintrosort otherwise. The cached variant is only compiled in with
+   SS_CACHED_KEYS. */
+template <typename CharT = unsigned char, typename ResultT = int> static inline void ss_blocksort(const CharT *T, const ResultT *PA, ResultT *first, ResultT *last, uint64_t *K, ResultT depth) {
+  if constexpr ((SS_CACHED_KEYS != 0) && (sizeof(CharT) == 1) && std::is_unsigned_v<CharT>) {
+    if(K != nullptr) { ss_mintrosort_cached(T, PA, first, last, K, depth); return; }
+  }
+  ss_mintrosort(T, PA, first, last, depth);
+}
+
 #endif /* (SS_BLOCKSIZE == 0) || (SS_INSERTIONSORT_THRESHOLD < SS_BLOCKSIZE) */
 
 
@@ -454,7 +664,7 @@ template <typename CharT = unsigned char, typename ResultT = int> static void ss
         0 < len;
         len = half, half >>= 1) {
       b = a + half;
-      q = ss_compare(T, PA + ((0 <= *b) ? *b : ~*b), p, depth);
+      q = ss_compare(T, PA + ((0 <= *b) ? *b : static_cast<ResultT>(~*b)), p, depth);
       if(q < 0) {
         a = b + 1;
         half -= (len & 1) ^ 1;
@@ -592,7 +802,7 @@ template <typename CharT = unsigned char, typename ResultT = int> static void ss
   };
   
   auto get_idx = [](auto a) {
-    return (0 <= a) ? a : ~a;
+    return (0 <= a) ? a : static_cast<ResultT>(~a);
   };
   
   auto merge_check = [&](auto a, auto b, auto c) {
@@ -674,8 +884,60 @@ template <typename CharT = unsigned char, typename ResultT = int> static void ss
   }
 }
 
+/* Splits the merge of [first, middle) and [middle, last) into two
+   independent ones for merging on several threads. The head v of the tie
+   group at the middle of the longer run is the pivot: the suffixes of the
+   other run less than v are found by binary search and rotated in front of
+   those of the longer run not less than v. Returns the boundary and sets
+   *lmiddle and *rmiddle to the middles of the left and right merges. Each
+   part starts with a group head and no tie group straddles the boundary,
+   so both can be merged with ss_swapmerge as they are. */
+template <typename CharT = unsigned char, typename ResultT = int> static ResultT * ss_splitmerge(const CharT *T, const ResultT *PA, ResultT *first, ResultT *middle, ResultT *last, ResultT depth, ResultT **lmiddle, ResultT **rmiddle) {
+  ResultT *a, *b, *v;
+  ResultT len, half;
+
+  auto lower_bound = [&](ResultT *l, ResultT *r) {
+    for(len = r - l; 0 < len;) {
+      half = len >> 1;
+      if(ss_compare(T, PA + ((0 <= l[half]) ? l[half] : static_cast<ResultT>(~l[half])), PA + *v, depth) < 0) {
+        l += half + 1, len -= half + 1;
+      } else {
+        len = half;
+      }
+    }
+    return l;
+  };
+
+  if((last - middle) <= (middle - first)) {
+    for(a = v = first + ((middle - first) >> 1); (first < v) && (*v < 0); a = --v) { }
+    b = lower_bound(middle, last);
+  } else {
+    for(b = v = middle + ((last - middle) >> 1); (middle < v) && (*v < 0); b = --v) { }
+    a = lower_bound(first, middle);
+  }
+  ss_rotate<ResultT>(a, middle, b);
+  *lmiddle = a;
+  *rmiddle = b;
+  return a + (b - middle);
+}
+
 #endif /* SS_BLOCKSIZE != 0 */
 
+
+/*---------------------------------------------------------------------------*/
+
+/* Inserts the last type B* suffix, stored at *(first - 1), into the sorted
+   range [first, last). */
+template <typename CharT = unsigned char, typename ResultT = int> static void ss_insert_lastsuffix(const CharT *T, const ResultT *PA, ResultT *first, ResultT *last, ResultT depth, ResultT n) {
+  ResultT *a;
+  ResultT i;
+  ResultT PAi[2] = { PA[*(first - 1)], n - 2};
+  for(a = first, i = *(first - 1); (a < last) && ((*a < 0) || (0 < ss_compare(T, &(PAi[0]), PA + *a, depth))); ++a) {
+    *(a - 1) = *a;
+  }
+  *(a - 1) = i;
+}
+
 } // namespace divss::internal
 
 /*---------------------------------------------------------------------------*/
@@ -693,13 +955,22 @@ template <typename CharT = unsigned char, typename ResultT = int> void sssort(co
   ResultT j, k, curbufsize, limit;
 #endif
   ResultT i;
+  uint64_t *keys = nullptr;
 
   if(lastsuffix != 0) {
     ++first;
   }
 
+  /* cache the keys of a block in buf when it is large enough */
+  if constexpr ((SS_CACHED_KEYS != 0) && (sizeof(CharT) == 1) && std::is_unsigned_v<CharT> && ((SS_BLOCKSIZE == 0) || (SS_INSERTIONSORT_THRESHOLD < SS_BLOCKSIZE))) {
+    void *p = buf;
+    std::size_t space = (0 < bufsize) ? static_cast<std::size_t>(bufsize) * sizeof(ResultT) : 0;
+    std::size_t size = static_cast<std::size_t>(((SS_BLOCKSIZE == 0) || ((last - first) < SS_BLOCKSIZE)) ? (last - first) : SS_BLOCKSIZE);
+    if(std::align(alignof(uint64_t), size * sizeof(uint64_t), p, space) != nullptr) { keys = static_cast<uint64_t *>(p); }
+  }
+
   if constexpr (SS_BLOCKSIZE == 0) {
-    internal::ss_mintrosort(T, PA, first, last, depth);
+    internal::ss_blocksort(T, PA, first, last, keys, depth);
   } else {
     if((bufsize < SS_BLOCKSIZE) && (bufsize < (last - first)) && (bufsize < (limit = internal::ss_isqrt(last - first)))) {
       if(SS_BLOCKSIZE < limit) {
@@ -712,7 +983,7 @@ template <typename CharT = unsigned char, typename ResultT = int> void sssort(co
     
     for(a = first, i = 0; SS_BLOCKSIZE < (middle - a); a += SS_BLOCKSIZE, ++i) {
       if constexpr (SS_INSERTIONSORT_THRESHOLD < SS_BLOCKSIZE) {
-        internal::ss_mintrosort(T, PA, a, a + SS_BLOCKSIZE, depth);
+        internal::ss_blocksort(T, PA, a, a + SS_BLOCKSIZE, keys, depth);
       } else if constexpr (1 < SS_BLOCKSIZE) {
         internal::ss_insertionsort(T, PA, a, a + SS_BLOCKSIZE, depth);
       }
@@ -728,7 +999,7 @@ template <typename CharT = unsigned char, typename ResultT = int> void sssort(co
     }
   
     if constexpr (SS_INSERTIONSORT_THRESHOLD < SS_BLOCKSIZE) {
-      internal::ss_mintrosort(T, PA, a, middle, depth);
+      internal::ss_blocksort(T, PA, a, middle, keys, depth);
     } else if (1 < SS_BLOCKSIZE) {
       internal::ss_insertionsort(T, PA, a, middle, depth);
     }
@@ -750,12 +1021,7 @@ template <typename CharT = unsigned char, typename ResultT = int> void sssort(co
   }
 
   if(lastsuffix != 0) {
-    /* Insert last type B* suffix. */
-    ResultT PAi[2] = { PA[*(first - 1)], n - 2};
-    for(a = first, i = *(first - 1); (a < last) && ((*a < 0) || (0 < internal::ss_compare(T, &(PAi[0]), PA + *a, depth))); ++a) {
-      *(a - 1) = *a;
-    }
-    *(a - 1) = i;
+    internal::ss_insert_lastsuffix(T, PA, first, last, depth, n);
   }
 }
 
@@ -763,3 +1029,5 @@ template <typename CharT = unsigned char, typename ResultT = int> void sssort(co
 
 
 
+
+#endif
@@ -24,14 +24,20 @@
  * OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#ifndef LIBDIVSUFSORT_TRSORT_HPP
+#define LIBDIVSUFSORT_TRSORT_HPP
+
 #include "common.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <vector>
 
 namespace divss::internal {
 
 /*- Private Functions -*/
 
 template <typename ResultT> static inline int32_t tr_ilg(ResultT n) {
-  if constexpr (sizeof(ResultT) == 8) {
+  if constexpr (4 < sizeof(ResultT)) {
     return (n >> 32) ?
           ((n >> 48) ?
             ((n >> 56) ?
@@ -63,7 +69,7 @@ template <typename ResultT> static inline int32_t tr_ilg(ResultT n) {
 /*---------------------------------------------------------------------------*/
 
 /* Simple insertionsort for small size groups. */
-template <typename ResultT> static void tr_insertionsort(const ResultT *ISAd, ResultT *first, ResultT *last) {
+template <typename ResultT, typename ISAdT = const ResultT *> static void tr_insertionsort(ISAdT ISAd, ResultT *first, ResultT *last) {
   ResultT *a, *b;
   ResultT t, r;
 
@@ -80,7 +86,7 @@ template <typename ResultT> static void tr_insertionsort(const ResultT *ISAd, Re
 
 /*---------------------------------------------------------------------------*/
 
-template <typename ResultT> static inline void tr_fixdown(const ResultT *ISAd, ResultT *SA, ResultT i, ResultT size) {
+template <typename ResultT, typename ISAdT = const ResultT *> static inline void tr_fixdown(ISAdT ISAd, ResultT *SA, ResultT i, ResultT size) {
   ResultT j, k;
   ResultT v;
   ResultT c, d, e;
@@ -94,7 +100,7 @@ template <typename ResultT> static inline void tr_fixdown(const ResultT *ISAd, R
 }
 
 /* Simple top-down heapsort. */
-template <typename ResultT> static void tr_heapsort(const ResultT *ISAd, ResultT *SA, ResultT size) {
+template <typename ResultT, typename ISAdT = const ResultT *> static void tr_heapsort(ISAdT ISAd, ResultT *SA, ResultT size) {
   ResultT i, m;
   ResultT t;
 
@@ -117,7 +123,7 @@ template <typename ResultT> static void tr_heapsort(const ResultT *ISAd, ResultT
 /*---------------------------------------------------------------------------*/
 
 /* Returns the median of three elements. */
-template <typename ResultT> static inline ResultT * tr_median3(const ResultT *ISAd, ResultT *v1, ResultT *v2, ResultT *v3) {
+template <typename ResultT, typename ISAdT = const ResultT *> static inline ResultT * tr_median3(ISAdT ISAd, ResultT *v1, ResultT *v2, ResultT *v3) {
   if(ISAd[*v1] > ISAd[*v2]) { std::swap(v1, v2); }
   if(ISAd[*v2] > ISAd[*v3]) {
     if(ISAd[*v1] > ISAd[*v3]) { return v1; }
@@ -127,7 +133,7 @@ template <typename ResultT> static inline ResultT * tr_median3(const ResultT *IS
 }
 
 /* Returns the median of five elements. */
-template <typename ResultT> static inline ResultT * tr_median5(const ResultT *ISAd, ResultT *v1, ResultT *v2, ResultT *v3, ResultT *v4, ResultT *v5) {
+template <typename ResultT, typename ISAdT = const ResultT *> static inline ResultT * tr_median5(ISAdT ISAd, ResultT *v1, ResultT *v2, ResultT *v3, ResultT *v4, ResultT *v5) {
   if(ISAd[*v2] > ISAd[*v3]) { std::swap(v2, v3); }
   if(ISAd[*v4] > ISAd[*v5]) { std::swap(v4, v5); }
   if(ISAd[*v2] > ISAd[*v4]) { std::swap(v2, v4); std::swap(v3, v5); }
@@ -138,7 +144,7 @@ template <typename ResultT> static inline ResultT * tr_median5(const ResultT *IS
 }
 
 /* Returns the pivot element. */
-template <typename ResultT> static inline ResultT * tr_pivot(const ResultT *ISAd, ResultT *first, ResultT *last) {
+template <typename ResultT, typename ISAdT = const ResultT *> static inline ResultT * tr_pivot(ISAdT ISAd, ResultT *first, ResultT *last) {
   ResultT *middle;
   ResultT t;
 
@@ -186,7 +192,7 @@ static inline int32_t trbudget_check(trbudget_t *budget, int size) {
 
 /*---------------------------------------------------------------------------*/
 
-template <typename ResultT> static inline void tr_partition(const ResultT *ISAd, ResultT *first, ResultT *middle, ResultT *last, ResultT **pa, ResultT **pb, ResultT v) {
+template <typename ResultT, typename ISAdT = const ResultT *> static inline void tr_partition(ISAdT ISAd, ResultT *first, ResultT *middle, ResultT *last, ResultT **pa, ResultT **pb, ResultT v) {
   ResultT *a, *b, *c, *d, *e, *f;
   ResultT t, s;
   ResultT x = 0;
@@ -224,7 +230,9 @@ template <typename ResultT> static inline void tr_partition(const ResultT *ISAd,
   *pa = first, *pb = last;
 }
 
-template <typename ResultT> static void tr_copy(ResultT *ISA, const ResultT *SA, ResultT *first, ResultT *a, ResultT *b, ResultT *last, ResultT depth) {
+/* ranks[i] reads the rank of suffix i like ISA[i]; under trsort_parallel it
+   leaves the ranks of the other groups to the round snapshot. */
+template <typename ResultT, typename ISAdT = const ResultT *> static void tr_copy(ResultT *ISA, ISAdT ranks, const ResultT *SA, ResultT *first, ResultT *a, ResultT *b, ResultT *last, ResultT depth) {
   /* sort suffixes of middle partition
      by using sorted order of suffixes of left and right partition. */
   ResultT *c, *d, *e;
@@ -232,20 +240,20 @@ template <typename ResultT> static void tr_copy(ResultT *ISA, const ResultT *SA,
 
   v = b - SA - 1;
   for(c = first, d = a - 1; c <= d; ++c) {
-    if((0 <= (s = *c - depth)) && (ISA[s] == v)) {
+    if((0 <= (s = *c - depth)) && (ranks[s] == v)) {
       *++d = s;
       ISA[s] = d - SA;
     }
   }
   for(c = last - 1, e = d + 1, d = b; e < d; --c) {
-    if((0 <= (s = *c - depth)) && (ISA[s] == v)) {
+    if((0 <= (s = *c - depth)) && (ranks[s] == v)) {
       *--d = s;
       ISA[s] = d - SA;
     }
   }
 }
 
-template <typename ResultT> static void tr_partialcopy(ResultT *ISA, const ResultT *SA, ResultT *first, ResultT *a, ResultT *b, ResultT *last, ResultT depth) {
+template <typename ResultT, typename ISAdT = const ResultT *> static void tr_partialcopy(ResultT *ISA, ISAdT ranks, const ResultT *SA, ResultT *first, ResultT *a, ResultT *b, ResultT *last, ResultT depth) {
   ResultT *c, *d, *e;
   ResultT s, v;
   ResultT rank, lastrank, newrank = -1;
@@ -253,9 +261,9 @@ template <typename ResultT> static void tr_partialcopy(ResultT *ISA, const Resul
   v = b - SA - 1;
   lastrank = -1;
   for(c = first, d = a - 1; c <= d; ++c) {
-    if((0 <= (s = *c - depth)) && (ISA[s] == v)) {
+    if((0 <= (s = *c - depth)) && (ranks[s] == v)) {
       *++d = s;
-      rank = ISA[s + depth];
+      rank = ranks[s + depth];
       if(lastrank != rank) { lastrank = rank; newrank = d - SA; }
       ISA[s] = newrank;
     }
@@ -270,18 +278,18 @@ template <typename ResultT> static void tr_partialcopy(ResultT *ISA, const Resul
 
   lastrank = -1;
   for(c = last - 1, e = d + 1, d = b; e < d; --c) {
-    if((0 <= (s = *c - depth)) && (ISA[s] == v)) {
+    if((0 <= (s = *c - depth)) && (ranks[s] == v)) {
       *--d = s;
-      rank = ISA[s + depth];
+      rank = ranks[s + depth];
       if(lastrank != rank) { lastrank = rank; newrank = d - SA; }
       ISA[s] = newrank;
     }
   }
 }
 
-template <typename ResultT> static void tr_introsort(ResultT *ISA, const ResultT *ISAd, ResultT *SA, ResultT *first, ResultT *last, trbudget_t *budget) {
+template <typename ResultT, typename ISAdT = const ResultT *> static void tr_introsort(ResultT *ISA, ISAdT ISAd, ResultT *SA, ResultT *first, ResultT *last, trbudget_t *budget) {
   struct stack_type {
-    const ResultT *a;
+    ISAdT a;
     ResultT *b;
     ResultT *c;
     int32_t d;
@@ -345,10 +353,10 @@ template <typename ResultT> static void tr_introsort(ResultT *ISA, const ResultT
         a = stack.top().b;
         b = stack.top().c;
         if(stack.top().d == 0) {
-          tr_copy<ResultT>(ISA, SA, first, a, b, last, ISAd - ISA);
+          tr_copy<ResultT>(ISA, ISAd - (ISAd - ISA), SA, first, a, b, last, ISAd - ISA);
         } else {
           if(0 <= trlink) { stack[trlink].d = -1; }
-          tr_partialcopy<ResultT>(ISA, SA, first, a, b, last, ISAd - ISA);
+          tr_partialcopy<ResultT>(ISA, ISAd - (ISAd - ISA), SA, first, a, b, last, ISAd - ISA);
         }
         stack.pop();
         if (stack.size() == 0) return;
@@ -516,6 +524,108 @@ template <typename ResultT> static void tr_introsort(ResultT *ISA, const ResultT
 #undef STACK_SIZE
 }
 
+
+/*---------------------------------------------------------------------------*/
+
+/* Rank lookup used by trsort_parallel. Ranks of the group being sorted are
+   read from ISA, ranks of every other group from a snapshot taken at the
+   start of the doubling round, so a group is sorted exactly as if it was
+   the first one of the round, whatever the other threads are refining. */
+template <typename ResultT> struct tr_isad_t {
+  const ResultT *isa = nullptr;
+  const ResultT *snapshot = nullptr;
+  ResultT owner = 0; /* rank of the members of the group at the start of the round */
+
+  constexpr tr_isad_t(std::nullptr_t = nullptr) noexcept { }
+  constexpr tr_isad_t(const ResultT *isa_, const ResultT *snapshot_, ResultT owner_) noexcept: isa{isa_}, snapshot{snapshot_}, owner{owner_} { }
+
+  constexpr ResultT operator[](ResultT i) const noexcept {
+    ResultT r = snapshot[i];
+    return (r == owner) ? isa[i] : r;
+  }
+  constexpr tr_isad_t operator+(ResultT d) const noexcept { return {isa + d, snapshot + d, owner}; }
+  constexpr tr_isad_t operator-(ResultT d) const noexcept { return {isa - d, snapshot - d, owner}; }
+  constexpr tr_isad_t & operator+=(ResultT d) noexcept { isa += d, snapshot += d; return *this; }
+  constexpr ResultT operator-(const ResultT *ISA) const noexcept { return isa - ISA; }
+};
+
+/* Tandem repeat sort of the unsorted groups of each doubling round on several
+   threads. The groups of a round are collected first, sorted by tr_introsort
+   largest first with a budget per thread, and the sorted ones are folded into
+   the skip runs once all threads are done. buf[0..bufsize-1] holds the rank
+   snapshot if it is large enough. The snapshot is copied from ISA once; as
+   only the members of the groups of a round are reranked, they alone are
+   brought up to date after it, unless it was the last round or they make
+   up a quarter of the text. */
+template <typename ResultT> static void trsort_parallel(ResultT *ISA, ResultT *SA, ResultT n, ResultT depth, unsigned threads, ResultT *buf, ResultT bufsize) {
+  struct segment_type {
+    ResultT *first;
+    ResultT *last;
+    ResultT count; /* 0 if sorted, budget.count of tr_introsort otherwise */
+  };
+  std::vector<segment_type> segments;
+  std::vector<segment_type *> groups;
+  std::vector<trbudget_t> budgets(threads);
+  std::vector<ResultT> storage;
+  ResultT *snapshot;
+  ResultT *first, *last;
+  ResultT t, d, skip, unsorted, members;
+
+  if(bufsize < n) { storage.resize(n); snapshot = storage.data(); }
+  else { snapshot = buf; }
+  std::copy(ISA, ISA + n, snapshot);
+
+  for(auto & budget: budgets) { trbudget_init(&budget, tr_ilg(n) * 2 / 3, n); }
+  for(d = depth; -n < *SA; d += d) {
+    /* Collect the groups of this round. */
+    segments.clear();
+    groups.clear();
+    members = 0;
+    first = SA;
+    do {
+      if((t = *first) < 0) { last = first - t; }
+      else { last = SA + ISA[t] + 1; }
+      segments.push_back({first, last, static_cast<ResultT>((t < 0) ? 0 : (last - first - 1))});
+      first = last;
+    } while(first < (SA + n));
+    for(auto & segment: segments) {
+      if(segment.count != 0) { groups.push_back(&segment); members += segment.last - segment.first; }
+    }
+    std::sort(groups.begin(), groups.end(), [](const segment_type * a, const segment_type * b) { return (a->last - a->first) > (b->last - b->first); });
+
+    /* Sort them. */
+    parallel_for(threads, groups.size(), [&](std::size_t idx, unsigned tid) {
+      segment_type & group = *groups[idx];
+      budgets[tid].count = 0;
+      tr_introsort(ISA, tr_isad_t<ResultT>{ISA, snapshot, static_cast<ResultT>(group.last - SA - 1)} + d,
+                   SA, group.first, group.last, &budgets[tid]);
+      group.count = budgets[tid].count;
+    });
+
+    /* Bring the snapshot up to date, in one sweep if the groups covered a
+       large part of it. */
+    if(std::any_of(groups.begin(), groups.end(), [](const segment_type * g) { return g->count != 0; })) {
+      if((n / 4) <= members) { std::copy(ISA, ISA + n, snapshot); }
+      else {
+        parallel_for(threads, groups.size(), [&](std::size_t idx, unsigned) {
+          for(const ResultT *p = groups[idx]->first; p < groups[idx]->last; ++p) { snapshot[*p] = ISA[*p]; }
+        });
+      }
+    }
+
+    /* Merge the sorted groups into skip runs. */
+    for(skip = 0, unsorted = 0; auto & segment: segments) {
+      if(segment.count == 0) { skip -= segment.last - segment.first; }
+      else {
+        if(skip != 0) { *(segment.first + skip) = skip; skip = 0; }
+        unsorted += segment.count;
+      }
+    }
+    if(skip != 0) { *(SA + n + skip) = skip; }
+    if(unsorted == 0) { break; }
+  }
+}
+
 } // namespace divss::internal
 
 /*---------------------------------------------------------------------------*/
@@ -525,12 +635,17 @@ namespace divss {
 /*- Function -*/
 
 /* Tandem repeat sort */
-template <typename ResultT> void trsort(ResultT *ISA, ResultT *SA, ResultT n, ResultT depth) noexcept {
+template <typename ResultT> void trsort(ResultT *ISA, ResultT *SA, ResultT n, ResultT depth, unsigned threads = 1, ResultT *buf = nullptr, ResultT bufsize = 0) {
   ResultT *ISAd;
   ResultT *first, *last;
   internal::trbudget_t budget;
   ResultT t, skip, unsorted;
 
+  if(1 < threads) {
+    internal::trsort_parallel(ISA, SA, n, depth, threads, buf, bufsize);
+    return;
+  }
+
   internal::trbudget_init(&budget, internal::tr_ilg(n) * 2 / 3, n);
 /*  trbudget_init(&budget, tr_ilg(n) * 3 / 4, n); */
   for(ISAd = ISA + depth; -n < *SA; ISAd += ISAd - ISA) {
@@ -559,3 +674,5 @@ template <typename ResultT> void trsort(ResultT *ISA, ResultT *SA, ResultT n, Re
 }
 
 } // namespace divss 
+
+#endif
@@ -24,13 +24,26 @@
  * OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#ifndef LIBDIVSUFSORT_UTILS_HPP
+#define LIBDIVSUFSORT_UTILS_HPP
+
 #include "common.hpp"
+#include "divsufsort.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <bit>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#define SEARCH_BATCH (16)
+#define KMER_MAX_BITS (28)
 
 
 /*- Private Function -*/
 
 /* Binary search for inverse bwt. */
-template <typename CharT, typename ResultT> static ResultT binarysearch_lower(const ResultT *A, ResultT size, ResultT value) {
+template <typename ResultT> static ResultT binarysearch_lower(const ResultT *A, ResultT size, ResultT value) {
   ResultT half, i;
   for(i = 0, half = size >> 1;
       0 < size;
@@ -46,21 +59,26 @@ template <typename CharT, typename ResultT> static ResultT binarysearch_lower(co
 
 /*- Functions -*/
 
-/* Burrows-Wheeler transform. */
-template <typename CharT, typename ResultT> int32_t bw_transform(const CharT *T, CharT *U, ResultT *SA, ResultT n, ResultT *idx) {
+/* Burrows-Wheeler transform. When indexes is not null, it also receives the
+   primary indexes of the positions multiple of interval (see divbwt). */
+template <typename CharT, typename ResultT> int32_t bw_transform(const CharT *T, CharT *U, ResultT *SA, ResultT n, ResultT *idx, ResultT *indexes = nullptr, no_deduce<ResultT> interval = 0) {
   ResultT *A, i, j, p, t;
   int32_t c;
 
   /* Check arguments. */
-  if((T == nullptr) || (U == nullptr) || (n < 0) || (idx == nullptr)) { return -1; }
+  if((T == nullptr) || (U == nullptr) || (n < 0) || (idx == nullptr) || ((indexes != nullptr) && (interval < 1))) { return -1; }
   if(n <= 1) {
-    if(n == 1) { U[0] = T[0]; }
+    if(n == 1) { U[0] = T[0]; if(indexes != nullptr) { indexes[0] = 1; } }
     *idx = n;
     return 0;
   }
 
+  auto sample = [&](ResultT suf, ResultT row) {
+    if((indexes != nullptr) && ((suf % interval) == 0)) { indexes[suf / interval] = row; }
+  };
+
   if((A = SA) == nullptr) {
-    i = divbwt(T, U, nullptr, n);
+    i = divss::divbwt(T, U, static_cast<ResultT *>(nullptr), n, 1, indexes, interval);
     if(0 <= i) { *idx = i; i = 0; }
     return static_cast<int32_t>(i);
   }
@@ -71,6 +89,7 @@ template <typename CharT, typename ResultT> int32_t bw_transform(const CharT *T,
     for(i = 0, j = 0; i < n; ++i) {
       p = t - 1;
       t = A[i];
+      sample(t, i + 1);
       if(0 <= p) {
         c = T[j];
         U[j] = (j <= p) ? T[p] : static_cast<CharT>(A[p]);
@@ -93,6 +112,7 @@ template <typename CharT, typename ResultT> int32_t bw_transform(const CharT *T,
     for(i = 0; A[i] != 0; ++i) { U[i + 1] = T[A[i] - 1]; }
     *idx = i + 1;
     for(++i; i < n; ++i) { U[i] = T[A[i] - 1]; }
+    for(i = 0; i < n; ++i) { sample(A[i], i + 1); }
   }
 
   if(SA == nullptr) {
@@ -103,8 +123,16 @@ template <typename CharT, typename ResultT> int32_t bw_transform(const CharT *T,
   return 0;
 }
 
-/* Inverse Burrows-Wheeler transform. */
-template <typename CharT, typename ResultT> int32_t inverse_bw_transform(const CharT *T, CharT *U, ResultT *A, ResultT n, ResultT idx) {
+/* Inverse Burrows-Wheeler transform. When indexes holds the primary indexes
+   of the positions multiple of interval (see divbwt), the segments between
+   them are decoded independently on `threads` threads, and so is the
+   counting and scattering of T that precedes them.
+   Each entry of the LF table packs the code of the symbol of its row with
+   the next row, so decoding a symbol is a single load. The table lives in A
+   when the packed entries fit in ResultT and in 8n bytes of its own
+   otherwise. With indexes, IBWT_CHAINS segments are decoded in lockstep so
+   that their cache misses overlap. */
+template <typename CharT, typename ResultT> int32_t inverse_bw_transform(const CharT *T, CharT *U, ResultT *A, ResultT n, ResultT idx, const ResultT *indexes = nullptr, no_deduce<ResultT> interval = 0, unsigned threads = 1) {
   ResultT C[alphabet_size<CharT>];
   CharT D[alphabet_size<CharT>];
   ResultT *B;
@@ -113,36 +141,128 @@ template <typename CharT, typename ResultT> int32_t inverse_bw_transform(const C
 
   /* Check arguments. */
   if((T == nullptr) || (U == nullptr) || (n < 0) || (idx < 0) ||
-     (n < idx) || ((0 < n) && (idx == 0))) {
+     (n < idx) || ((0 < n) && (idx == 0)) || ((indexes != nullptr) && (interval < 1))) {
     return -1;
   }
-  if(n <= 1) { return 0; }
-
-  if((B = A) == nullptr) {
-    /* Allocate n*sizeof(ResultT) bytes of memory. */
-    B = new ResultT[n];
-    if (B == nullptr) {
-      return -2;
+  if(n <= 1) { if(n == 1) { U[0] = T[0]; } return 0; }
+  if(indexes != nullptr) {
+    if(indexes[0] != idx) { return -1; }
+    for(i = 0; i <= (n - 1) / interval; ++i) {
+      if((indexes[i] < 1) || (n < indexes[i])) { return -1; }
     }
+  } else {
+    threads = 1;
   }
-
-  /* Inverse BW transform. */
-  for(c = 0; c < alphabet_size<CharT>; ++c) { C[c] = 0; }
-  for(i = 0; i < n; ++i) { ++C[T[i]]; }
-  for(c = 0, d = 0, i = 0; c < alphabet_size<CharT>; ++c) {
-    p = C[c];
-    if(0 < p) {
-      C[c] = i;
-      D[d++] = static_cast<CharT>(c);
-      i += p;
+  if(threads < 1) { threads = 1; }
+  if(n < static_cast<ResultT>(threads) * IBWT_MIN_SEGMENT) { threads = 1; }
+
+  /* Each thread counts its own range of T; the buckets are then laid out so
+     that it scatters its range after the ranges before it. */
+  std::vector<ResultT> count(static_cast<std::size_t>(threads) * alphabet_size<CharT>, 0);
+  std::vector<uint32_t> code(alphabet_size<CharT>);
+  auto range = [&](unsigned t) { return static_cast<ResultT>(n / static_cast<ResultT>(threads) * static_cast<ResultT>(t)); };
+  divss::internal::parallel_run(threads, [&](unsigned t) {
+    ResultT *cnt = &count[t * alphabet_size<CharT>];
+    for(ResultT j = range(t), e = (t + 1 == threads) ? n : range(t + 1); j < e; ++j) { ++cnt[T[j]]; }
+  });
+  for(c = 0, d = 0, i = 0; c < static_cast<int32_t>(alphabet_size<CharT>); ++c) {
+    for(unsigned t = 0; t < threads; ++t) {
+      p = count[t * alphabet_size<CharT> + c], count[t * alphabet_size<CharT> + c] = i, i += p;
     }
+    if(count[c] < i) { code[c] = static_cast<uint32_t>(d), D[d++] = static_cast<CharT>(c); }
+    C[c] = i;
   }
-  for(i = 0; i < idx; ++i) { B[C[T[i]]++] = i; }
-  for( ; i < n; ++i)       { B[C[T[i]]++] = i + 1; }
+  auto scatter = [&](auto *L, auto entry) {
+    divss::internal::parallel_run(threads, [&](unsigned t) {
+      ResultT *pos = &count[t * alphabet_size<CharT>];
+      for(ResultT j = range(t), e = (t + 1 == threads) ? n : range(t + 1); j < e; ++j) { L[pos[T[j]]++] = entry(j); }
+    });
+  };
+
+  /* Decodes with the packed table L: entry j of row j + 1 holds the code of
+     its symbol in the low `bits` bits and the entry of the next row above
+     them (0 past the last symbol, as it is never followed). */
+  const int bits = std::max(1, static_cast<int>(std::bit_width(static_cast<uint32_t>(d - 1))));
+  auto decode = [&](auto *L) {
+    using WordT = std::remove_pointer_t<decltype(L)>;
+    const WordT mask = (WordT(1) << bits) - 1;
+    scatter(L, [&](ResultT j) {
+      return static_cast<WordT>((static_cast<WordT>(j - ((0 < j) && (j < idx))) << bits) | code[T[j]]);
+    });
+    if(indexes == nullptr) {
+      WordT q = static_cast<WordT>(idx - 1), w;
+      for(i = 0; i < n; ++i) { w = L[q], U[i] = D[w & mask], q = w >> bits; }
+      return;
+    }
+    /* Segments k * interval .. (k + 1) * interval - 1 are handed out in groups
+       of IBWT_CHAINS; the full ones of a group advance together, one symbol
+       each per round, and the short last segment of the block alone. */
+    const std::size_t segments = static_cast<std::size_t>((n - 1) / interval) + 1;
+    const std::size_t full = static_cast<std::size_t>(n / interval);
+    divss::internal::parallel_for(threads, (segments + IBWT_CHAINS - 1) / IBWT_CHAINS, [&](std::size_t g, unsigned) {
+      const std::size_t first = g * IBWT_CHAINS, last = std::min(first + IBWT_CHAINS, segments);
+      const std::size_t m = std::min(last, full) - std::min(first, full);
+      const std::size_t len = static_cast<std::size_t>(interval);
+      WordT q[IBWT_CHAINS], w;
+      CharT *u = U + static_cast<std::size_t>(first) * len;
+      std::size_t j, k;
+      for(k = 0; k < m; ++k) { q[k] = static_cast<WordT>(indexes[first + k] - 1); }
+      for(j = 0; j < len; ++j) {
+        for(k = 0; k < m; ++k) {
+          w = L[q[k]], u[k * len + j] = D[w & mask], q[k] = w >> bits;
+          __builtin_prefetch(&L[q[k]]);
+        }
+      }
+      if(m < last - first) {
+        q[0] = static_cast<WordT>(indexes[segments - 1] - 1);
+        for(j = (segments - 1) * len; j < static_cast<std::size_t>(n); ++j) { w = L[q[0]], U[j] = D[w & mask], q[0] = w >> bits; }
+      }
+    });
+  };
+
+  if constexpr(std::is_integral_v<ResultT>) {
+    using WordT = std::make_unsigned_t<ResultT>;
+    if((static_cast<uint64_t>(n - 1) >> (std::numeric_limits<WordT>::digits - bits)) == 0) {
+      if((B = A) == nullptr) {
+        /* Allocate n*sizeof(ResultT) bytes of memory. */
+        B = new(std::nothrow) ResultT[n];
+        if(B == nullptr) { return -2; }
+      }
+      decode(reinterpret_cast<WordT *>(B));
+      if(A == nullptr) { delete[] B; }
+      return 0;
+    }
+  }
+  if((static_cast<uint64_t>(n - 1) >> (64 - bits)) == 0) {
+    uint64_t *L = new(std::nothrow) uint64_t[n];
+    if(L != nullptr) {
+      decode(L);
+      delete[] L;
+      return 0;
+    }
+  }
+
+  /* The packed entries do not fit: search the bucket of each row instead. */
+  if((B = A) == nullptr) {
+    /* Allocate n*sizeof(ResultT) bytes of memory. */
+    B = new(std::nothrow) ResultT[n];
+    if(B == nullptr) { return -2; }
+  }
+  scatter(B, [&](ResultT j) { return static_cast<ResultT>(j + (idx <= j)); });
   for(c = 0; c < d; ++c) { C[c] = C[D[c]]; }
-  for(i = 0, p = idx; i < n; ++i) {
-    U[i] = D[binarysearch_lower(C, d, p)];
-    p = B[p - 1];
+  if(indexes == nullptr) {
+    for(i = 0, p = idx; i < n; ++i) {
+      U[i] = D[binarysearch_lower(C, static_cast<ResultT>(d), p)];
+      p = B[p - 1];
+    }
+  } else {
+    divss::internal::parallel_for(threads, static_cast<std::size_t>((n - 1) / interval) + 1, [&](std::size_t k, unsigned) {
+      ResultT j = static_cast<ResultT>(k) * interval, e = std::min<ResultT>(n, j + interval), q = indexes[k];
+      for(; j < e; ++j) {
+        U[j] = D[binarysearch_lower(C, static_cast<ResultT>(d), q)];
+        q = B[q - 1];
+      }
+    });
   }
 
   if(A == nullptr) {
@@ -309,6 +429,144 @@ template <typename CharT, typename ResultT> ResultT sa_search(const CharT *T, Re
   return k - j;
 }
 
+/* A pattern of a batched search. Each bound is the first suffix of SA[lo,
+   lo + len) that is not less than P (for the upper one, neither less nor
+   starting with P), lmatch and rmatch being the lengths of P matched by the
+   suffixes just outside. While joint, the two bounds are searched as one,
+   in lower, until a suffix starting with P is met. */
+template <typename CharT, typename ResultT> struct sa_search_lane {
+  struct bound { ResultT lo, len, lmatch, rmatch; };
+  const CharT *P;
+  ResultT Psize;
+  bound lower, upper;
+  bool joint;
+};
+
+/* Runs the lanes SEARCH_BATCH at a time, advancing each bound of each lane by
+   one step per round so that their cache misses overlap. After a step, the
+   text of the next probe and the entries of SA of the two probes that may
+   follow it are prefetched. */
+template <typename CharT, typename ResultT> static void sa_search_lanes(const CharT *T, ResultT Tsize, const ResultT *SA, sa_search_lane<CharT, ResultT> *lanes, std::size_t size) {
+  using bound = typename sa_search_lane<CharT, ResultT>::bound;
+  auto probe = [&](const sa_search_lane<CharT, ResultT> & l, const bound & b, ResultT *match) {
+    *match = std::min(b.lmatch, b.rmatch);
+    return _compare(T, Tsize, l.P, l.Psize, SA[b.lo + (b.len >> 1)], match);
+  };
+  auto step = [](bound & b, ResultT match, bool right) {
+    ResultT half = b.len >> 1;
+    if(right) { b.lo += half + 1, b.len -= half + 1, b.lmatch = match; }
+    else      { b.len = half, b.rmatch = match; }
+  };
+
+  for(std::size_t first = 0, last; first < size; first = last) {
+    last = std::min<std::size_t>(first + SEARCH_BATCH, size);
+    for(bool active = true; active;) {
+      active = false;
+      for(std::size_t k = first; k < last; ++k) {
+        sa_search_lane<CharT, ResultT> & l = lanes[k];
+        ResultT match;
+        int32_t r;
+        if(0 < l.lower.len) {
+          r = probe(l, l.lower, &match);
+          if(l.joint && (r == 0)) {
+            ResultT half = l.lower.len >> 1;
+            l.upper = {l.lower.lo + half + 1, l.lower.len - half - 1, match, l.lower.rmatch}, l.joint = false;
+          }
+          step(l.lower, match, r < 0);
+        }
+        if(0 < l.upper.len) {
+          r = probe(l, l.upper, &match);
+          step(l.upper, match, r <= 0);
+        }
+        for(const bound *b: {&l.lower, &l.upper}) {
+          if(0 < b->len) {
+            ResultT half = b->len >> 1, p = b->lo + half;
+            __builtin_prefetch(&SA[b->lo + (half >> 1)]);
+            __builtin_prefetch(&SA[p + 1 + ((b->len - half - 1) >> 1)]);
+            __builtin_prefetch(&T[SA[p] + std::min(b->lmatch, b->rmatch)]);
+            active = true;
+          }
+        }
+      }
+    }
+    /* A pattern never met has both bounds where the lower one ended. */
+    for(std::size_t k = first; k < last; ++k) {
+      if(lanes[k].joint) { lanes[k].upper.lo = lanes[k].lower.lo; }
+    }
+  }
+}
+
+/* Searches the patterns P[0], ..., P[k - 1] of lengths Psize[0], ...,
+   Psize[k - 1] in the string T at once. counts[q] receives the number of
+   occurrences of P[q] and idx[q], when idx is not null, the index of the
+   first one in SA, as sa_search does. The searches advance in lock step, and
+   when sorted is true the patterns are sorted first: those of a batch are
+   then searched between the bounds of its first and last pattern only, past
+   the prefix the two have in common. Returns 0, or -1 on invalid arguments. */
+template <typename CharT, typename ResultT> int32_t sa_search_batch(const CharT *T, ResultT Tsize, const CharT *const *P, const ResultT *Psize, ResultT k, const ResultT *SA, ResultT SAsize, ResultT *counts, ResultT *idx = nullptr, bool sorted = false) {
+  using lane = sa_search_lane<CharT, ResultT>;
+  ResultT q;
+
+  if((T == nullptr) || (P == nullptr) || (Psize == nullptr) || (SA == nullptr) || (counts == nullptr) ||
+     (Tsize < 0) || (k < 0) || (SAsize < 0)) {
+    return -1;
+  }
+  for(q = 0; q < k; ++q) {
+    if((P[q] == nullptr) || (Psize[q] < 0)) { return -1; }
+  }
+  if((Tsize == 0) || (SAsize == 0)) {
+    for(q = 0; q < k; ++q) {
+      counts[q] = 0;
+      if(idx != nullptr) { idx[q] = -1; }
+    }
+    return 0;
+  }
+
+  /* Lane j searches the j-th pattern of order. */
+  const std::size_t m = static_cast<std::size_t>(k);
+  std::vector<ResultT> order(m);
+  std::vector<lane> lanes(m);
+  for(q = 0; q < k; ++q) { order[q] = q; }
+  if(sorted) {
+    std::sort(order.begin(), order.end(), [&](ResultT a, ResultT b) {
+      return std::lexicographical_compare(P[a], P[a] + Psize[a], P[b], P[b] + Psize[b]);
+    });
+  }
+  for(std::size_t j = 0; j < m; ++j) {
+    lanes[j] = {P[order[j]], Psize[order[j]], {0, SAsize, 0, 0}, {0, 0, 0, 0}, true};
+  }
+
+  if(sorted) {
+    /* All the patterns of a batch start with the prefix H its first and last
+       pattern have in common, so the suffixes they match lie between the
+       lower bound of the first one and the upper bound of H, and share H.
+       These two bounds are searched first, then the patterns within them. */
+    std::vector<lane> outer;
+    std::vector<ResultT> common;
+    for(std::size_t first = 0; first < m; first += SEARCH_BATCH) {
+      const lane & a = lanes[first], & z = lanes[std::min<std::size_t>(first + SEARCH_BATCH, m) - 1];
+      ResultT h = 0;
+      for(; (h < a.Psize) && (h < z.Psize) && (a.P[h] == z.P[h]); ++h) { }
+      outer.push_back({a.P, a.Psize, {0, SAsize, 0, 0}, {0, 0, 0, 0}, false});
+      outer.push_back({a.P, h, {0, 0, 0, 0}, {0, SAsize, 0, 0}, false});
+      common.push_back(h);
+    }
+    sa_search_lanes(T, Tsize, SA, outer.data(), outer.size());
+    for(std::size_t j = 0; j < m; ++j) {
+      const std::size_t b = j / SEARCH_BATCH;
+      const ResultT lo = outer[2 * b].lower.lo, hi = outer[2 * b + 1].upper.lo;
+      lanes[j].lower = {lo, hi - lo, common[b], common[b]};
+    }
+  }
+  sa_search_lanes(T, Tsize, SA, lanes.data(), lanes.size());
+
+  for(std::size_t j = 0; j < m; ++j) {
+    counts[order[j]] = lanes[j].upper.lo - lanes[j].lower.lo;
+    if(idx != nullptr) { idx[order[j]] = lanes[j].lower.lo; }
+  }
+  return 0;
+}
+
 /* Search for the character c in the string T. */
 template <typename CharT, typename ResultT> ResultT sa_simplesearch(const CharT *T, ResultT Tsize, const ResultT *SA, ResultT SAsize, int32_t c, ResultT *idx) {
   ResultT size, lsize, rsize, half;
@@ -361,3 +619,125 @@ template <typename CharT, typename ResultT> ResultT sa_simplesearch(const CharT
   if(idx != nullptr) { *idx = (0 < (k - j)) ? j : i; }
   return k - j;
 }
+
+/* Table of the SA intervals of the k-mers of a string T. The symbols of T are
+   numbered 0, ..., sigma - 1, and the suffix at i is keyed by the codes of
+   T[i, i + k) in bits bits each, padded with code 0 past the end of T. The
+   key order is the suffix order, so the suffixes of each key form the
+   interval [start[key], start[key + 1]) of the suffix array, and the table is
+   counted from T alone. k is lowered so that a key fits in KMER_MAX_BITS. */
+template <typename CharT, typename ResultT> class sa_kmer_table {
+public:
+  /* Builds the table of T[0..n-1]; returns 0, or -1 on invalid arguments. */
+  int32_t build(const CharT *T, ResultT n, int32_t k) {
+    ResultT i;
+
+    if((T == nullptr) || (n < 0) || (k < 1)) { return -1; }
+    n_ = n, symbols_.clear();
+    if constexpr(sizeof(CharT) <= 2) {
+      code_.assign(alphabet_size<CharT>, -1);
+      for(i = 0; i < n; ++i) { code_[T[i]] = 0; }
+      for(std::size_t c = 0; c < alphabet_size<CharT>; ++c) {
+        if(code_[c] == 0) { code_[c] = static_cast<int32_t>(symbols_.size()), symbols_.push_back(static_cast<CharT>(c)); }
+      }
+    } else {
+      symbols_.assign(T, T + n);
+      std::sort(symbols_.begin(), symbols_.end());
+      symbols_.erase(std::unique(symbols_.begin(), symbols_.end()), symbols_.end());
+    }
+    bits_ = std::max(1, static_cast<int32_t>(std::bit_width(std::max<std::size_t>(symbols_.size(), 1) - 1)));
+    k_ = std::min(k, std::max(KMER_MAX_BITS / bits_, 1));
+
+    /* Count the keys of the suffixes, then turn the counts into starts. */
+    const uint64_t mask = (uint64_t{1} << (k_ * bits_)) - 1;
+    uint64_t key = 0;
+    start_.assign(static_cast<std::size_t>(mask) + 2, 0);
+    for(i = 0; i < k_; ++i) { key = (key << bits_) | ((i < n) ? code(T[i]) : 0); }
+    for(i = 0; i < n; ++i) {
+      ++start_[key];
+      key = ((key << bits_) & mask) | ((i + k_ < n) ? code(T[i + k_]) : 0);
+    }
+    ResultT sum = 0;
+    for(auto & s: start_) { ResultT t = s; s = sum, sum += t; }
+    return 0;
+  }
+
+  /* Sets [lo, hi) to the interval of the suffixes starting with P[0..m-1]
+     if m <= k, with its first k symbols otherwise. The interval may start
+     with some of the last m - 1 suffixes, shorter than P. Returns false
+     when P has a symbol that T has not (or the table is empty). */
+  bool interval(const CharT *P, ResultT m, ResultT *lo, ResultT *hi) const noexcept {
+    uint64_t key = 0;
+    int32_t c, j, h = static_cast<int32_t>(std::min<ResultT>(m, k_));
+    if(start_.empty()) { return false; }
+    for(j = 0; j < h; ++j) {
+      if((c = code(P[j])) < 0) { return false; }
+      key = (key << bits_) | static_cast<uint64_t>(c);
+    }
+    const int32_t pad = (k_ - h) * bits_;
+    *lo = start_[key << pad], *hi = start_[((key + 1) << pad)];
+    return true;
+  }
+
+  int32_t k() const noexcept { return k_; }
+  ResultT size() const noexcept { return n_; }
+  std::size_t size_in_bytes() const noexcept {
+    return start_.size() * sizeof(ResultT) + code_.size() * sizeof(int32_t) + symbols_.size() * sizeof(CharT);
+  }
+
+private:
+  int32_t code(CharT c) const noexcept {
+    if constexpr(sizeof(CharT) <= 2) {
+      return code_[c];
+    } else {
+      auto it = std::lower_bound(symbols_.begin(), symbols_.end(), c);
+      return ((it != symbols_.end()) && (*it == c)) ? static_cast<int32_t>(it - symbols_.begin()) : -1;
+    }
+  }
+
+  std::vector<ResultT> start_;
+  std::vector<int32_t> code_;
+  std::vector<CharT> symbols_;
+  ResultT n_ = 0;
+  int32_t k_ = 0, bits_ = 1;
+};
+
+/* Search for the pattern P in the string T, starting from the interval of
+   its first symbols in table, a table of T and of SA[0..SAsize-1] as built
+   by sa_kmer_table::build. Patterns of at most k symbols need no search. */
+template <typename CharT, typename ResultT> ResultT sa_search(const CharT *T, ResultT Tsize, const CharT *P, ResultT Psize, const ResultT *SA, ResultT SAsize, ResultT *idx, const sa_kmer_table<CharT, ResultT> & table) {
+  ResultT lo, hi, size;
+
+  if((T == nullptr) || (P == nullptr) || (SA == nullptr) || (Tsize <= 0) || (Psize <= 0) ||
+     (SAsize != Tsize) || (table.size() != Tsize) || !table.interval(P, Psize, &lo, &hi)) {
+    return sa_search(T, Tsize, P, Psize, SA, SAsize, idx);
+  }
+
+  if(Psize <= table.k()) {
+    /* Skip the suffixes shorter than P at the start of the interval. */
+    for(; (lo < hi) && (Tsize - SA[lo] < Psize); ++lo) { }
+  }
+  if((Psize <= table.k()) || (lo == hi)) {
+    if(idx != nullptr) { *idx = lo; }
+    return hi - lo;
+  }
+  size = sa_search(T, Tsize, P, Psize, SA + lo, hi - lo, idx);
+  if(idx != nullptr) { *idx += lo; }
+  return size;
+}
+
+/* Search for the character c in the string T, as the interval of c in
+   table (see sa_search above). */
+template <typename CharT, typename ResultT> ResultT sa_simplesearch(const CharT *T, ResultT Tsize, const ResultT *SA, ResultT SAsize, int32_t c, ResultT *idx, const sa_kmer_table<CharT, ResultT> & table) {
+  ResultT lo, hi;
+  const CharT d = static_cast<CharT>(c);
+
+  if((T == nullptr) || (SA == nullptr) || (Tsize <= 0) || (SAsize != Tsize) || (table.size() != Tsize) ||
+     (static_cast<int32_t>(d) != c) || !table.interval(&d, 1, &lo, &hi)) {
+    return sa_simplesearch(T, Tsize, SA, SAsize, c, idx);
+  }
+  if(idx != nullptr) { *idx = lo; }
+  return hi - lo;
+}
+
+#endif